@@ -1,9 +1,11 @@
 #!/usr/bin/env python3
 """Analyze power traces."""
 
+import os
 from binascii import unhexlify
+from concurrent.futures import ThreadPoolExecutor
 from pathlib import Path
-from typing import Annotated, List, Optional
+from typing import Annotated, Any, Dict, List, Optional, Tuple, Union
 
 import cpa_lib
 import numpy as np
@@ -11,13 +13,54 @@ import pandas as pd
 import typer
 import zarr
 from rich.progress import track
-from scipy import signal
+from scipy import signal, stats
 
 from esp_cpa_board import SignalPreprocessor, load_config
 from esp_cpa_board.aes_utils import AesDecryptOperationType, derivate_round_keys
+from esp_cpa_board.collision import candidate_keys, resolve_deltas
+from esp_cpa_board.convergence import ConvergenceMonitor
+from esp_cpa_board.drift import interpolate_temperatures
+from esp_cpa_board.key_rank import correlation_log_likelihoods, estimate_key_rank
+from esp_cpa_board.utils import (
+    poi_slices,
+    poi_windows,
+    required_samples,
+)
 
 app = typer.Typer()
 
+# Round 0 candidates per byte of compute-correlations-fanout, see its documentation
+MAX_FANOUT_TOP_K = 3
+
+
+@app.callback()
+def select_device(
+    platform: Annotated[
+        Optional[int], typer.Option(help="OpenCL platform index")
+    ] = None,
+    device: Annotated[Optional[int], typer.Option(help="OpenCL device index")] = None,
+    all_devices: Annotated[
+        bool,
+        typer.Option(
+            help="Share the guesses across all the devices (of the platform, if given)"
+        ),
+    ] = False,
+):
+    """Select the OpenCL device used by the solvers, see list-devices."""
+    if platform is not None:
+        os.environ["CPA_LIB_PLATFORM"] = str(platform)
+    if device is not None:
+        os.environ["CPA_LIB_DEVICE"] = str(device)
+    elif all_devices:
+        os.environ["CPA_LIB_DEVICE"] = "all"
+
+
+@app.command()
+def list_devices():
+    """List the available OpenCL devices."""
+    for platform, device, platform_name, device_name in cpa_lib.opencl_devices():
+        print(f"{platform}:{device}\t{platform_name} - {device_name}")
+
 
 @app.command()
 def extract_traces(
@@ -146,16 +189,343 @@ def extract_spread(
     result.to_csv(output_filename)
 
 
+def _chunk_temperatures(
+    data_f: Any, configs: List[Dict[str, Any]], start: int, stop: int
+) -> Optional[np.ndarray]:
+    """Get the temperature of each trace of a chunk, when a configuration needs it.
+
+    Temperatures are only read for drift_compensation = "temperature", so that
+    captures without temperatures (e.g. grouped ones) can still be analyzed.
+
+    Args:
+        data_f (Any): The capture
+        configs (List[Dict[str, Any]]): The analysis configurations
+        start (int): Index of the first trace
+        stop (int): Index after the last trace
+
+    Returns:
+        Optional[np.ndarray]: The temperatures, None if no configuration uses them
+    """
+    if not any(c.get("drift_compensation") == "temperature" for c in configs):
+        return None
+    if "temperatures" not in data_f:
+        raise typer.BadParameter(
+            "Temperature drift compensation needs a capture with temperatures"
+        )
+    return interpolate_temperatures(data_f["temperatures"], start, stop)
+
+
+def _n_poi_results(config: Dict[str, Any]) -> int:
+    """Get the number of POIs of each byte in the results of a configuration.
+
+    With per-byte POIs, results hold as many samples as the largest window, zero
+    padded.
+
+    Args:
+        config (Dict[str, Any]): The analysis configuration
+
+    Returns:
+        int: The number of POIs
+    """
+    windows = poi_windows(config)
+    return len(config["poi"]) if windows is None else max(windows)
+
+
+def _require_shared_poi(config: Dict[str, Any]) -> None:
+    """Reject per-byte POIs, for commands that process all the bytes at once.
+
+    Args:
+        config (Dict[str, Any]): The analysis configuration
+    """
+    if poi_windows(config) is not None:
+        raise typer.BadParameter("Per-byte POIs are not supported by this command")
+
+
+def _require_correlations(corr: Any) -> None:
+    """Reject results that don't hold Pearson correlation coefficients.
+
+    LRA (coefficients of determination) and MIA (mutual information, in bits)
+    scores can't be turned into likelihoods the way correlations are.
+
+    Args:
+        corr (Any): The results, see `_compute_correlations`
+    """
+    solver = corr.attrs.get("solver", "cpa")
+    if solver != "cpa":
+        raise typer.BadParameter(
+            f"The results hold {solver} scores, not correlation coefficients"
+        )
+
+
+def _build_solver(config: Dict[str, Any], k_index: int, profiling: bool = False) -> Any:
+    """Build the solver selected by an analysis configuration.
+
+    Args:
+        config (Dict[str, Any]): The analysis configuration
+        k_index (int): The index of the key byte to attack
+        profiling (bool): Enable OpenCL profiling (CPA solver only). Defaults to False.
+
+    Returns:
+        Any: The solver
+    """
+    solver = config.get("solver", "cpa")
+    if solver == "cpa":
+        return cpa_lib.CpaSolver(
+            config["model"],
+            k_index,
+            config["model_beta_modifier"],
+            config["model_args"],
+            profiling=profiling,
+        )
+    elif solver == "lra":
+        # The leakage is learnt from the bits of the intermediate value
+        return cpa_lib.LraSolver(config["model"], k_index, config["model_args"])
+    elif solver == "mia":
+        # Histograms of the samples against the Hamming weight of the intermediate value
+        return cpa_lib.MiaSolver(
+            config["model"],
+            k_index,
+            config["model_args"],
+            n_bins=config.get("mia_bins", 16),
+        )
+    else:
+        raise typer.BadParameter(f"Unknown solver {solver}")
+
+
+def _compute_correlations(
+    data_filename: Path,
+    config_filenames: List[Path],
+    output_filenames: List[Path],
+    convergence_monitors: Optional[List[ConvergenceMonitor]] = None,
+    profiling: bool = False,
+) -> None:
+    """Compute correlations values for several configurations in a single pass.
+
+    Each chunk of the capture is read once. Configurations sharing the same
+    filter parameters also share the filtering step.
+
+    With per-byte POIs, each byte is only correlated with its own window, and the
+    CPA of the 16 bytes runs in a single solver. Results hold as many samples as
+    the largest window, zero padded.
+
+    Args:
+        data_filename (Path): The capture file
+        config_filenames (List[Path]): The analysis configuration files
+        output_filenames (List[Path]): The output file of each configuration
+        convergence_monitors (Optional[List[ConvergenceMonitor]]): One monitor per
+            configuration. If given, stop once all of them report convergence, and
+            truncate the results to the processed steps. Defaults to None.
+        profiling (bool): Print the cumulative timings of the solvers. Defaults to False.
+    """
+    configs = [load_config(f) for f in config_filenames]
+    signal_preprocessors = [SignalPreprocessor(config) for config in configs]
+
+    # Group configurations sharing the same filtering stage
+    filter_groups: Dict[Tuple[Any, ...], List[int]] = {}
+    for n, signal_preprocessor in enumerate(signal_preprocessors):
+        filter_groups.setdefault(signal_preprocessor.filter_key, []).append(n)
+
+    data_f = zarr.open(data_filename, "r")
+
+    samples_array = data_f["samples"]
+    payloads_array = data_f["payloads"]
+
+    chunk_size = data_f["samples"].chunks[0]
+    n_measurements = (payloads_array.shape[0] // chunk_size) * chunk_size
+
+    results = []
+    all_solvers = []
+    all_windows = []
+    for config, output_filename in zip(configs, output_filenames):
+        windows = poi_windows(config)
+        n_poi_samples = _n_poi_results(config)
+        all_windows.append(poi_slices(config))
+
+        result = zarr.open(
+            output_filename,
+            mode="w-",
+            shape=(
+                16,
+                n_measurements // chunk_size,
+                256,
+                n_poi_samples,
+            ),
+            chunks=(1, 1, 256, n_poi_samples),
+            dtype="f",
+        )
+        # Number of traces per step, for plots
+        result.attrs["chunk_size"] = chunk_size
+        result.attrs["solver"] = config.get("solver", "cpa")
+        results.append(result)
+
+        if windows is not None and config.get("solver", "cpa") == "cpa":
+            solvers = [
+                cpa_lib.WindowedCpaSolver(
+                    config["model"],
+                    config["model_beta_modifier"],
+                    windows,
+                    config["model_args"],
+                    profiling=profiling,
+                )
+            ]
+        else:
+            solvers = [_build_solver(config, i, profiling) for i in range(16)]
+        all_solvers.append(solvers)
+
+    n_samples = max(required_samples(config) for config in configs)
+
+    for i in track(range(0, n_measurements, chunk_size)):
+        chunk = samples_array[i : i + chunk_size][:, :, :n_samples]
+
+        # Don't forget to flip the plaintext (ESP32 implementation detail)
+        plaintext = np.flip(
+            payloads_array[i : i + chunk_size],
+            axis=1,
+        )
+
+        scores = np.zeros((len(configs), 16, 256))
+        temperatures = _chunk_temperatures(data_f, configs, i, i + chunk_size)
+        for indexes in filter_groups.values():
+            filtered = signal_preprocessors[indexes[0]].filter(chunk)
+
+            for n in indexes:
+                s = signal_preprocessors[n].select(filtered, temperatures)
+
+                # Compute correlation for each byte
+                if len(all_solvers[n]) == 1:
+                    all_solvers[n][0].update(plaintext, s)
+                    mat = np.abs(all_solvers[n][0].get_result())
+                    mats = [mat[:, w] for w in all_windows[n]]
+                else:
+                    mats = []
+                    for j, w in enumerate(all_windows[n]):
+                        all_solvers[n][j].update(plaintext, s[:, w])
+                        mats.append(np.abs(all_solvers[n][j].get_result()))
+
+                for j, mat in enumerate(mats):
+                    results[n][j, i // chunk_size, :, : mat.shape[1]] = mat
+                    scores[n, j] = np.max(mat, axis=1)
+
+        if convergence_monitors is not None:
+            converged = [
+                m.update(scores[n], i + chunk_size)
+                for n, m in enumerate(convergence_monitors)
+            ]
+            if all(converged):
+                n_steps = i // chunk_size + 1
+                print(f"Converged after {i + chunk_size} traces")
+                for result in results:
+                    result.resize((16, n_steps) + result.shape[2:])
+                break
+
+    if profiling:
+        for config_filename, solvers in zip(config_filenames, all_solvers):
+            # Only the CPA solvers report timings
+            if not all(hasattr(solver, "stats") for solver in solvers):
+                print(f"{config_filename}: no timings for this solver")
+                continue
+            stats: Dict[str, float] = {}
+            for solver in solvers:
+                for name, value in solver.stats().items():
+                    stats[name] = stats.get(name, 0.0) + value
+            print(f"{config_filename}:")
+            for name, value in stats.items():
+                print(f"    {name} = {value:0.3f}")
+
+
 @app.command()
 def compute_correlations(
     data_filename: Path,
     config_filename: Path,
     output_filename: Path,
+    early_stop: Annotated[
+        bool, typer.Option(help="Stop once the best guesses are settled")
+    ] = False,
+    min_margin: float = 5.0,
+    stable_steps: int = 10,
+    confidence: Optional[float] = None,
+    profiling: Annotated[
+        bool, typer.Option(help="Report OpenCL and host side timings")
+    ] = False,
+) -> None:
+    """Compute correlations values.
+
+    With early stopping, the margin between the best and second best guesses of
+    each byte (in standard deviations), the number of steps the best guesses stayed
+    the same for, and optionally a bootstrap confidence are monitored. Margins
+    are computed from correlation coefficients, so early stopping is only
+    available for CPA.
+    """
+    convergence_monitors = None
+    if early_stop:
+        if load_config(config_filename).get("solver", "cpa") != "cpa":
+            raise typer.BadParameter("Early stopping is only available for CPA")
+        convergence_monitors = [
+            ConvergenceMonitor(min_margin, stable_steps, confidence)
+        ]
+
+    _compute_correlations(
+        data_filename,
+        [config_filename],
+        [output_filename],
+        convergence_monitors,
+        profiling,
+    )
+
+
+@app.command()
+def compute_correlations_batch(
+    data_filename: Path,
+    output_directory: Path,
+    config_filenames: List[Path],
 ) -> None:
-    """Compute correlations values."""
+    """Compute correlations values for several configurations, reading the capture once.
+
+    One result file is written per configuration, named after the configuration file.
+    """
+    stems = [f.stem for f in config_filenames]
+    if len(set(stems)) != len(stems):
+        raise typer.BadParameter("Configuration file names must be unique")
+
+    output_directory.mkdir(parents=True, exist_ok=True)
+    output_filenames = [output_directory / f"{stem}.zarr" for stem in stems]
+
+    _compute_correlations(data_filename, config_filenames, output_filenames)
+
+
+@app.command()
+def compare_models(
+    data_filename: Path,
+    config_filename: Path,
+    output_filename: Path,
+    beta_modifier: Annotated[Optional[List[float]], typer.Option()] = None,
+    key: Optional[str] = None,
+) -> None:
+    """Compute correlations values for several leakage model variants in a single pass.
+
+    Variants are read from the `variants` list of the configuration, as
+    (model, model_beta_modifier, model_args) tuples. Otherwise, the model of the
+    configuration is evaluated with each of the given beta modifiers. The output is
+    shaped (16, steps, n_variants, 256, n_poi), and variant names are stored in the
+    `variants` attribute.
+    """
     config = load_config(config_filename)
     signal_preprocessor = SignalPreprocessor(config)
 
+    if "variants" in config:
+        variants = [tuple(v) for v in config["variants"]]
+    elif beta_modifier:
+        variants = [(config["model"], b, config["model_args"]) for b in beta_modifier]
+    else:
+        raise typer.BadParameter("No variants in configuration, and no beta modifier")
+
+    names = [
+        f"{m} (beta = {b})" if a is None else f"{m} (beta = {b}, args = {a})"
+        for m, b, a in variants
+    ]
+    if len(set(names)) != len(names):
+        raise typer.BadParameter("Variants must be distinct")
+
     data_f = zarr.open(data_filename, "r")
 
     samples_array = data_f["samples"]
@@ -164,7 +534,8 @@ def compute_correlations(
     chunk_size = data_f["samples"].chunks[0]
     n_measurements = (payloads_array.shape[0] // chunk_size) * chunk_size
 
-    n_poi_samples = len(config["poi"])
+    n_poi_samples = _n_poi_results(config)
+    windows = poi_slices(config)
 
     result = zarr.open(
         output_filename,
@@ -172,22 +543,172 @@ def compute_correlations(
         shape=(
             16,
             n_measurements // chunk_size,
+            len(variants),
             256,
             n_poi_samples,
         ),
-        chunks=(1, 1, 256, n_poi_samples),
+        chunks=(1, 1, len(variants), 256, n_poi_samples),
         dtype="f",
     )
+    result.attrs["variants"] = names
 
-    solvers = [
+    solvers = [cpa_lib.MultiModelCpaSolver(i, variants) for i in range(16)]
+
+    n_samples = required_samples(config)
+
+    for i in track(range(0, n_measurements, chunk_size)):
+        chunk = samples_array[i : i + chunk_size][:, :, :n_samples]
+
+        # Don't forget to flip the plaintext (ESP32 implementation detail)
+        plaintext = np.flip(
+            payloads_array[i : i + chunk_size],
+            axis=1,
+        )
+
+        temperatures = _chunk_temperatures(data_f, [config], i, i + chunk_size)
+        s = signal_preprocessor.process(chunk, temperatures)
+
+        for j, w in enumerate(windows):
+            solvers[j].update(plaintext, s[:, w])
+            mat = np.abs(solvers[j].get_result())
+            mat = mat.reshape(len(variants), 256, mat.shape[1])
+            result[j, i // chunk_size, :, :, : mat.shape[2]] = mat
+
+    # Summarize the last step
+    scores = np.max(result[:, -1], axis=3)  # (16, n_variants, 256)
+    for n, name in enumerate(names):
+        if key is not None:
+            k = np.frombuffer(unhexlify(key), dtype=np.uint8)
+            correct = scores[np.arange(16), n, k]
+            ranks = np.sum(scores[:, n, :] > correct[:, None], axis=1)
+            print(
+                f"{name}: mean rank = {np.mean(ranks):0.2f}, "
+                f"mean correlation = {np.mean(correct):0.5f}"
+            )
+        else:
+            best = np.max(scores[:, n, :], axis=1)
+            print(f"{name}: mean best correlation = {np.mean(best):0.5f}")
+
+
+@app.command()
+def compute_correlations_fanout(
+    data_filename: Path,
+    round0_config_filename: Path,
+    round1_config_filename: Path,
+    round0_output_filename: Path,
+    round1_output_filename: Path,
+    top_k: Annotated[
+        int,
+        typer.Option(help=f"Round 0 candidates per byte, at most {MAX_FANOUT_TOP_K}"),
+    ] = 2,
+    selection_step: int = 20,
+) -> None:
+    """Compute round 0 and round 1 correlations values in a single pass.
+
+    After selection_step chunks (or at the end of shorter captures), the top_k
+    round 0 candidates of each byte are selected. Round 1 hypotheses are then
+    evaluated for all the relevant combinations of these candidates. Round 1 POIs
+    of the first chunks are kept in memory, so the capture is only read once.
+
+    Each round 1 byte depends on 4 or 5 round 0 bytes, so its solver evaluates
+    top_k ** n_dependencies * 256 guesses per trace. At top_k = MAX_FANOUT_TOP_K
+    and with 5 dependencies, that is 62208 guesses, and the hypotheses of a 5000
+    traces chunk take about 2.5 GB (f64), plus as much while they are flattened.
+    """
+    if top_k < 1 or top_k > MAX_FANOUT_TOP_K:
+        raise typer.BadParameter(f"top_k must be between 1 and {MAX_FANOUT_TOP_K}")
+    if selection_step < 1:
+        raise typer.BadParameter("selection_step must be at least 1")
+
+    configs = [load_config(round0_config_filename), load_config(round1_config_filename)]
+    signal_preprocessors = [SignalPreprocessor(config) for config in configs]
+    share_filter = (
+        signal_preprocessors[0].filter_key == signal_preprocessors[1].filter_key
+    )
+
+    if configs[1]["model"] not in ("round1", "round1dectable"):
+        raise typer.BadParameter("The round 1 configuration must use a round 1 model")
+
+    data_f = zarr.open(data_filename, "r")
+
+    samples_array = data_f["samples"]
+    payloads_array = data_f["payloads"]
+
+    chunk_size = data_f["samples"].chunks[0]
+    n_measurements = (payloads_array.shape[0] // chunk_size) * chunk_size
+    n_steps = n_measurements // chunk_size
+    if n_steps == 0:
+        raise typer.BadParameter("The capture holds no complete chunk")
+    selection_step = min(selection_step, n_steps)
+
+    windows = [poi_slices(config) for config in configs]
+
+    results = []
+    for config, output_filename in zip(
+        configs, (round0_output_filename, round1_output_filename)
+    ):
+        n_poi_samples = _n_poi_results(config)
+        result = zarr.open(
+            output_filename,
+            mode="w-",
+            shape=(
+                16,
+                n_steps,
+                256,
+                n_poi_samples,
+            ),
+            chunks=(1, 1, 256, n_poi_samples),
+            dtype="f",
+        )
+        # Number of traces per step, for plots
+        result.attrs["chunk_size"] = chunk_size
+        results.append(result)
+
+    round0_solvers = [
         cpa_lib.CpaSolver(
-            config["model"], i, config["model_beta_modifier"], config["model_args"]
+            configs[0]["model"],
+            i,
+            configs[0]["model_beta_modifier"],
+            configs[0]["model_args"],
         )
         for i in range(16)
     ]
+    round1_solvers: List[Any] = []
+
+    def _update_round1(step: int, plaintext: np.ndarray, s: np.ndarray) -> None:
+        for j, w in enumerate(windows[1]):
+            round1_solvers[j].update(plaintext, s[:, w])
+            mat = np.abs(round1_solvers[j].get_result())
+            # Keep the best combination of round 0 candidates for each guess
+            mat = mat.reshape(-1, 256, mat.shape[1])
+            results[1][j, step, :, : mat.shape[2]] = np.max(mat, axis=0)
+
+    # Round 1 inputs of the steps processed before the candidates selection
+    buffered_steps: List[Tuple[int, np.ndarray, np.ndarray]] = []
+
+    def _select_candidates(round0_scores: np.ndarray) -> None:
+        nonlocal round1_solvers, buffered_steps
+        candidates = [
+            [int(c) for c in np.argsort(-round0_scores[j])[:top_k]] for j in range(16)
+        ]
+        round1_solvers = [
+            cpa_lib.FanoutCpaSolver(
+                configs[1]["model"],
+                j,
+                configs[1]["model_beta_modifier"],
+                candidates,
+            )
+            for j in range(16)
+        ]
+        for buffered_step in buffered_steps:
+            _update_round1(*buffered_step)
+        buffered_steps = []
+
+    n_samples = max(required_samples(config) for config in configs)
 
     for i in track(range(0, n_measurements, chunk_size)):
-        chunk = samples_array[i : i + chunk_size][:, :, : max(config["poi"]) + 256]
+        step = i // chunk_size
+        chunk = samples_array[i : i + chunk_size][:, :, :n_samples]
 
         # Don't forget to flip the plaintext (ESP32 implementation detail)
         plaintext = np.flip(
@@ -195,16 +716,416 @@ def compute_correlations(
             axis=1,
         )
 
-        s = signal_preprocessor.process(chunk)
+        filtered = signal_preprocessors[0].filter(chunk)
+        temperatures = _chunk_temperatures(data_f, configs, i, i + chunk_size)
+        s0 = signal_preprocessors[0].select(filtered, temperatures)
+        if not share_filter:
+            filtered = signal_preprocessors[1].filter(chunk)
+        s1 = signal_preprocessors[1].select(filtered, temperatures)
 
-        # Compute correlation for each byte
-        for j in range(16):
-            solvers[j].update(
+        round0_scores = np.zeros((16, 256))
+        for j, w in enumerate(windows[0]):
+            round0_solvers[j].update(
                 plaintext,
-                s,
+                s0[:, w],
             )
-            mat = np.abs(solvers[j].get_result())
-            result[j, i // chunk_size, :] = mat
+            mat = np.abs(round0_solvers[j].get_result())
+            results[0][j, step, :, : mat.shape[1]] = mat
+            round0_scores[j] = np.max(mat, axis=1)
+
+        if round1_solvers:
+            _update_round1(step, plaintext, s1)
+            continue
+
+        buffered_steps.append((step, plaintext, s1))
+
+        if step + 1 == selection_step:
+            _select_candidates(round0_scores)
+
+    # Deduce the round 0 key from the best combination of each round 1 byte
+    round1_key = []
+    votes: List[Dict[int, int]] = [{} for _ in range(16)]
+    for j, solver in enumerate(round1_solvers):
+        mat = np.abs(solver.get_result())
+        best_guess = np.unravel_index(np.argmax(mat), mat.shape)[0]
+        combination, guess = divmod(int(best_guess), 256)
+        round1_key.append(guess)
+        key = solver.get_combinations()[combination]
+        for k in solver.get_key_dependencies():
+            votes[k][key[k]] = votes[k].get(key[k], 0) + 1
+
+    round0_key = [max(v, key=lambda c: v[c]) for v in votes]
+
+    print(f"Round 0 key = {bytes(round0_key).hex()}")
+    print(f"Round 1 key = {bytes(round1_key).hex()}")
+
+
+def _filter_grid(
+    f_orders: List[int], low_cutoffs: List[float], high_cutoffs: List[float]
+) -> List[Tuple[str, int, Union[float, Tuple[float, float]]]]:
+    """Build the grid of filter settings explored by `sweep_filters`.
+
+    A null low cutoff stands for a low-pass filter, and a null high cutoff for a
+    high-pass filter. Low and high-pass settings have a single cutoff frequency,
+    as expected by `scipy.signal.butter`.
+
+    Args:
+        f_orders (List[int]): The filter orders
+        low_cutoffs (List[float]): The low cutoff frequencies
+        high_cutoffs (List[float]): The high cutoff frequencies
+
+    Returns:
+        List[Tuple[str, int, Union[float, Tuple[float, float]]]]: The (f_type, f_order, f_cutoff) settings
+    """
+    grid = []
+    for f_order in f_orders:
+        for low in low_cutoffs:
+            for high in high_cutoffs:
+                if low <= 0 and high <= 0:
+                    continue
+                elif low <= 0:
+                    grid.append(("low", f_order, high))
+                elif high <= 0:
+                    grid.append(("high", f_order, low))
+                elif low < high:
+                    grid.append(("band", f_order, (low, high)))
+    return grid
+
+
+@app.command()
+def sweep_filters(
+    data_filename: Path,
+    config_filename: Path,
+    output_filename: Path,
+    f_order: Annotated[List[int], typer.Option()] = [4, 8],
+    low_cutoff: Annotated[List[float], typer.Option()] = [0, 0.2e6, 0.35e6, 0.5e6],
+    high_cutoff: Annotated[List[float], typer.Option()] = [0.8e6, 1.2e6, 2e6, 0],
+    metric: Annotated[
+        str, typer.Option(help="Band evaluation metric, nicv or cpa")
+    ] = "nicv",
+    key: Annotated[
+        Optional[str], typer.Option(help="Score the correct key (cpa metric only)")
+    ] = None,
+    n_workers: Optional[int] = None,
+) -> None:
+    """Evaluate a grid of filter settings in a single pass over the capture.
+
+    The POIs, drift compensation and leakage model are taken from the configuration.
+    Each chunk is read and averaged once, then filtered with every setting in parallel.
+    Settings are scored by the mean (over bytes) of the best NICV at the POIs, or of
+    the best correlation value (of the correct key if it is given).
+    """
+    if metric not in ("nicv", "cpa"):
+        raise typer.BadParameter(f"Unknown metric {metric}")
+
+    raw_key = None
+    if key is not None:
+        raw_key = unhexlify(key)
+        if len(raw_key) != 16:
+            raise typer.BadParameter(
+                "The size of the round key is expected to be 16 bytes"
+            )
+
+    config = load_config(config_filename)
+    windows = poi_slices(config)
+    grid = _filter_grid(f_order, low_cutoff, high_cutoff)
+    if not grid:
+        raise typer.BadParameter("Empty filter grid")
+
+    signal_preprocessors = [
+        SignalPreprocessor(config | {"f_type": t, "f_order": o, "f_cutoff": c})
+        for t, o, c in grid
+    ]
+
+    if metric == "nicv":
+        solvers = [cpa_lib.SnrSolver() for _ in grid]
+    else:
+        solvers = [[_build_solver(config, j) for j in range(16)] for _ in grid]
+
+    data_f = zarr.open(data_filename, "r")
+
+    samples_array = data_f["samples"]
+    payloads_array = data_f["payloads"]
+
+    chunk_size = data_f["samples"].chunks[0]
+    n_measurements = (payloads_array.shape[0] // chunk_size) * chunk_size
+
+    n_samples = required_samples(config)
+
+    with ThreadPoolExecutor(max_workers=n_workers) as executor:
+        for i in track(range(0, n_measurements, chunk_size)):
+            chunk = samples_array[i : i + chunk_size][:, :, :n_samples]
+            # Average once, filter() then only has a single repetition left
+            chunk = np.mean(chunk, axis=1, keepdims=True)
+
+            # Don't forget to flip the plaintext (ESP32 implementation detail)
+            plaintext = np.flip(
+                payloads_array[i : i + chunk_size],
+                axis=1,
+            )
+
+            temperatures = _chunk_temperatures(data_f, [config], i, i + chunk_size)
+            processed = executor.map(
+                lambda p: p.process(chunk, temperatures),
+                signal_preprocessors,
+            )
+
+            for solver, s in zip(solvers, processed):
+                if metric == "nicv":
+                    solver.update(plaintext, s)
+                else:
+                    for j, w in enumerate(windows):
+                        solver[j].update(plaintext, s[:, w])
+
+    scores = []
+    for solver in solvers:
+        if metric == "nicv":
+            _, nicv = solver.get_result()
+            best_nicv = [np.max(nicv[j, w]) for j, w in enumerate(windows)]
+            scores.append(float(np.mean(best_nicv)))
+        else:
+            best = []
+            for j in range(16):
+                mat = np.abs(solver[j].get_result())
+                if raw_key is not None:
+                    best.append(np.max(mat[raw_key[j]]))
+                else:
+                    best.append(np.max(mat))
+            scores.append(float(np.mean(best)))
+
+    result = pd.DataFrame(
+        {
+            "F Type": [t for t, _, _ in grid],
+            "F Order": [o for _, o, _ in grid],
+            "F Cutoff": [c for _, _, c in grid],
+            "Score": scores,
+        }
+    ).sort_values("Score", ascending=False)
+
+    result.to_csv(output_filename, index=False)
+
+    print(result.head(10).to_string(index=False))
+
+    best = result.iloc[0]
+    print(f'f_type = "{best["F Type"]}"')
+    print(f"f_order = {best['F Order']}")
+    print(f"f_cutoff = {best['F Cutoff']}")
+
+
+@app.command()
+def build_templates(
+    data_filename: Path,
+    config_filename: Path,
+    key: str,
+    output_filename: Path,
+    projection: Annotated[
+        str, typer.Option(help="Dimensionality reduction: none, pca or lda")
+    ] = "none",
+    n_components: int = 4,
+) -> None:
+    """Build templates from a capture made with a known round key."""
+    config = load_config(config_filename)
+    _require_shared_poi(config)
+    signal_preprocessor = SignalPreprocessor(config)
+
+    raw_key = unhexlify(key)
+    if len(raw_key) != 16:
+        raise typer.BadParameter("The size of the round key is expected to be 16 bytes")
+
+    data_f = zarr.open(data_filename, "r")
+
+    samples_array = data_f["samples"]
+    payloads_array = data_f["payloads"]
+
+    chunk_size = data_f["samples"].chunks[0]
+    n_measurements = (payloads_array.shape[0] // chunk_size) * chunk_size
+
+    profilers = [
+        cpa_lib.TemplateProfiler(config["model"], i, raw_key[i], config["model_args"])
+        for i in range(16)
+    ]
+
+    for i in track(range(0, n_measurements, chunk_size)):
+        chunk = samples_array[i : i + chunk_size][:, :, : required_samples(config)]
+
+        # Don't forget to flip the plaintext (ESP32 implementation detail)
+        plaintext = np.flip(
+            payloads_array[i : i + chunk_size],
+            axis=1,
+        )
+
+        temperatures = _chunk_temperatures(data_f, [config], i, i + chunk_size)
+        s = signal_preprocessor.process(chunk, temperatures)
+
+        for j in range(16):
+            profilers[j].update(plaintext, s)
+
+    templates = [p.get_templates(projection, n_components) for p in profilers]
+
+    np.savez(
+        output_filename,
+        projection=np.array([t[0] for t in templates]),
+        means=np.array([t[1] for t in templates]),
+        covariance=np.array([t[2] for t in templates]),
+    )
+
+
+@app.command()
+def template_attack(
+    data_filename: Path,
+    config_filename: Path,
+    templates_filename: Path,
+    output_filename: Path,
+) -> None:
+    """Compute log-likelihoods of each key guess, using previously built templates.
+
+    The results are stored in the same format as correlation values, with a single
+    time index, and offset so that the least likely guess is 0.
+    """
+    config = load_config(config_filename)
+    _require_shared_poi(config)
+    signal_preprocessor = SignalPreprocessor(config)
+
+    templates = np.load(templates_filename)
+
+    data_f = zarr.open(data_filename, "r")
+
+    samples_array = data_f["samples"]
+    payloads_array = data_f["payloads"]
+
+    chunk_size = data_f["samples"].chunks[0]
+    n_measurements = (payloads_array.shape[0] // chunk_size) * chunk_size
+
+    result = zarr.open(
+        output_filename,
+        mode="w-",
+        shape=(
+            16,
+            n_measurements // chunk_size,
+            256,
+            1,
+        ),
+        chunks=(1, 1, 256, 1),
+        dtype="f",
+    )
+
+    solvers = [
+        cpa_lib.TemplateAttackSolver(
+            config["model"],
+            i,
+            templates["projection"][i],
+            templates["means"][i],
+            templates["covariance"][i],
+            config["model_args"],
+        )
+        for i in range(16)
+    ]
+
+    for i in track(range(0, n_measurements, chunk_size)):
+        chunk = samples_array[i : i + chunk_size][:, :, : required_samples(config)]
+
+        # Don't forget to flip the plaintext (ESP32 implementation detail)
+        plaintext = np.flip(
+            payloads_array[i : i + chunk_size],
+            axis=1,
+        )
+
+        temperatures = _chunk_temperatures(data_f, [config], i, i + chunk_size)
+        s = signal_preprocessor.process(chunk, temperatures)
+
+        for j in range(16):
+            solvers[j].update(plaintext, s)
+            log_likelihoods = solvers[j].get_result()
+            log_likelihoods -= np.min(log_likelihoods)
+            result[j, i // chunk_size, :, 0] = log_likelihoods
+
+
+@app.command()
+def find_poi(
+    data_filename: Path,
+    config_filename: Path,
+    output_filename: Path,
+    n_windows: int = 4,
+    window_size: int = 5,
+) -> None:
+    """Rank POI windows by SNR and NICV over plaintext byte classes (no key needed).
+
+    Only the filter parameters of the configuration are used.
+    """
+    config = load_config(config_filename)
+    signal_preprocessor = SignalPreprocessor(config)
+
+    data_f = zarr.open(data_filename, "r")
+
+    samples_array = data_f["samples"]
+    payloads_array = data_f["payloads"]
+
+    chunk_size = data_f["samples"].chunks[0]
+    n_measurements = (payloads_array.shape[0] // chunk_size) * chunk_size
+
+    solver = cpa_lib.SnrSolver()
+
+    for i in track(range(0, n_measurements, chunk_size)):
+        chunk = samples_array[i : i + chunk_size]
+
+        # Don't forget to flip the plaintext (ESP32 implementation detail)
+        plaintext = np.flip(
+            payloads_array[i : i + chunk_size],
+            axis=1,
+        )
+
+        solver.update(plaintext, signal_preprocessor.filter(chunk))
+
+    snr, nicv = solver.get_result()
+
+    # Greedily pick the best non-overlapping windows, based on the average NICV
+    score = np.mean(nicv, axis=0)
+    half_size = window_size // 2
+    # Windows are clipped at the edges of the traces, keep their peaks aside
+    peaks: List[int] = []
+    windows: List[range] = []
+    for t in np.argsort(-score).tolist():
+        if len(windows) == n_windows:
+            break
+        if any(abs(t - peak) < window_size for peak in peaks):
+            continue
+        peaks.append(t)
+        windows.append(range(max(t - half_size, 0), min(t + half_size + 1, len(score))))
+
+    for n, (peak, w) in enumerate(zip(peaks, windows)):
+        print(
+            f"Window {n}: {w.start}-{w.stop - 1} (peak at {peak}, "
+            f"NICV = {score[peak]:0.5f}, SNR = {np.mean(snr[:, peak]):0.5f})"
+        )
+
+    for j in range(16):
+        print(f"Byte {j}: best sample {np.argmax(nicv[j])}")
+
+    poi = sorted(t for w in windows for t in w)
+    print(f"poi = {poi}")
+
+    # Alternatively, a window around the best sample of each byte
+    per_byte_poi = {
+        j: list(range(max(t - half_size, 0), min(t + half_size + 1, nicv.shape[1])))
+        for j, t in enumerate(np.argmax(nicv, axis=1).tolist())
+    }
+    print(f"poi = {per_byte_poi}")
+
+    dataframes = []
+    for j in range(16):
+        df = pd.DataFrame(
+            {
+                "Sample Index": np.arange(0, snr.shape[1]),
+                "SNR": snr[j],
+                "NICV": nicv[j],
+                "Byte": j,
+            }
+        )
+        dataframes.append(df)
+
+    result = pd.concat(dataframes)
+
+    result.to_csv(output_filename)
 
 
 @app.command()
@@ -256,8 +1177,16 @@ def group_measurements(
     for n in range(config["n_groups"]):
         categories_counts[n] = 0
 
+    if config.get("alignment") is not None:
+        signal_preprocessor = SignalPreprocessor(config)
+
     for i in track(range(samples_array.shape[0] // chunk_size)):
         chunk = samples_array[i * chunk_size : (i + 1) * chunk_size]
+        if config.get("alignment") is not None:
+            # Align each repetition independently
+            chunk = signal_preprocessor.align(
+                chunk.reshape(-1, chunk.shape[2])
+            ).reshape(chunk.shape)
         if config["f_type"] is not None:
             f_chunk = signal.filtfilt(filter_b, filter_a, chunk, axis=2)
             categories = config["selector"](f_chunk)
@@ -280,6 +1209,8 @@ def group_measurements(
             categories_counts[-1] += np.count_nonzero(c == -1)
 
         for n in range(config["n_groups"]):
+            if not selected_samples[n]:
+                continue
             outputs[n]["samples"].append(selected_samples[n])
             outputs[n]["payloads"].append(selected_payloads[n])
 
@@ -353,6 +1284,291 @@ def compute_ranks(corr_filename: Path, key: str, output_filename: Path) -> None:
     result.to_csv(output_filename)
 
 
+def _rank_statistics(
+    ranks: np.ndarray, confidence: float
+) -> Dict[str, Tuple[np.ndarray, np.ndarray, np.ndarray]]:
+    """Get the success rate and guessing entropy of a set of rank curves.
+
+    Args:
+        ranks (np.ndarray): Ranks of the right key byte, shaped (n_permutations, n_steps)
+        confidence (float): Level of the confidence intervals
+
+    Returns:
+        Dict[str, Tuple[np.ndarray, np.ndarray, np.ndarray]]: The estimate, lower and upper bounds of each metric, per step
+    """
+    n = ranks.shape[0]
+    z = stats.norm.ppf(0.5 + confidence / 2)
+
+    # Wilson score interval
+    p = np.mean(ranks == 0, axis=0)
+    center = (p + z**2 / (2 * n)) / (1 + z**2 / n)
+    half_width = z * np.sqrt(p * (1 - p) / n + z**2 / (4 * n**2)) / (1 + z**2 / n)
+
+    # Guessing entropy, as the average rank
+    ge = np.mean(ranks, axis=0)
+    ge_half_width = z * np.std(ranks, axis=0, ddof=1 if n > 1 else 0) / np.sqrt(n)
+
+    return {
+        "Success Rate": (p, center - half_width, center + half_width),
+        "Guessing Entropy": (ge, ge - ge_half_width, ge + ge_half_width),
+    }
+
+
+@app.command()
+def compute_success_rate(
+    data_filename: Path,
+    config_filename: Path,
+    key: str,
+    output_filename: Path,
+    block_size: Annotated[
+        Optional[int],
+        typer.Option(help="Traces per step, must divide the capture chunk size"),
+    ] = None,
+    n_permutations: int = 200,
+    confidence: float = 0.95,
+    seed: Optional[int] = None,
+    max_memory: Annotated[
+        float, typer.Option(help="Limit of the memory used by the kept sums, in GB")
+    ] = 8.0,
+) -> None:
+    """Compute success rate and guessing entropy curves, given a known round key.
+
+    The capture is read once, and the correlation sums of each block of traces
+    are kept: 16 * 256 * n_poi values per block, so small blocks over long
+    captures need a lot of memory. Rank curves are then computed for n_permutations random orderings of
+    the blocks, from which the success rate (fraction of orderings ranking the
+    right guess first) and the guessing entropy (average rank) are estimated. The
+    "Key" success rate requires all the bytes to be right.
+    """
+    config = load_config(config_filename)
+    _require_shared_poi(config)
+    signal_preprocessor = SignalPreprocessor(config)
+
+    raw_key = unhexlify(key)
+    if len(raw_key) != 16:
+        raise typer.BadParameter("The size of the round key is expected to be 16 bytes")
+
+    data_f = zarr.open(data_filename, "r")
+
+    samples_array = data_f["samples"]
+    payloads_array = data_f["payloads"]
+
+    chunk_size = data_f["samples"].chunks[0]
+    n_measurements = (payloads_array.shape[0] // chunk_size) * chunk_size
+
+    if block_size is None:
+        block_size = chunk_size
+    if block_size <= 0 or chunk_size % block_size != 0:
+        raise typer.BadParameter(f"Block size must divide {chunk_size}")
+
+    # Sums of the samples, hypotheses and their products, in f64
+    n_poi = _n_poi_results(config)
+    block_bytes = 16 * 8 * (2 * n_poi + 2 * 256 + 256 * n_poi)
+    footprint = n_measurements // block_size * block_bytes / 2**30
+    if footprint > max_memory:
+        raise typer.BadParameter(
+            f"The sums of {n_measurements // block_size} blocks take "
+            f"{footprint:0.1f} GB, use larger blocks or raise --max-memory"
+        )
+
+    solver = cpa_lib.BootstrapSolver(
+        config["model"], config["model_beta_modifier"], config["model_args"]
+    )
+
+    n_samples = required_samples(config)
+
+    for i in track(range(0, n_measurements, chunk_size)):
+        chunk = samples_array[i : i + chunk_size][:, :, :n_samples]
+
+        # Don't forget to flip the plaintext (ESP32 implementation detail)
+        plaintext = np.flip(
+            payloads_array[i : i + chunk_size],
+            axis=1,
+        )
+
+        temperatures = _chunk_temperatures(data_f, [config], i, i + chunk_size)
+        s = signal_preprocessor.process(chunk, temperatures)
+
+        for j in range(0, chunk_size, block_size):
+            solver.update(plaintext[j : j + block_size], s[j : j + block_size])
+
+    ranks = solver.get_ranks(raw_key, n_permutations, seed)
+    n_steps = ranks.shape[1]
+
+    curves = [
+        (f"Byte {j}", _rank_statistics(ranks[:, :, j], confidence)) for j in range(16)
+    ]
+    # Full key success, and average guessing entropy over the bytes
+    key_statistics = _rank_statistics(np.max(ranks, axis=2), confidence)
+    average_statistics = _rank_statistics(np.mean(ranks, axis=2), confidence)
+    curves.append(("Key", {"Success Rate": key_statistics["Success Rate"]}))
+    curves.append(
+        ("Average", {"Guessing Entropy": average_statistics["Guessing Entropy"]})
+    )
+
+    dataframes = []
+    for name, metrics in curves:
+        columns: Dict[str, Any] = {
+            "Measurement Index": np.arange(1, n_steps + 1) * block_size,
+            "Name": name,
+        }
+        for metric, (estimate, lower, upper) in metrics.items():
+            columns[metric] = estimate
+            columns[f"{metric} Lower Bound"] = lower
+            columns[f"{metric} Upper Bound"] = upper
+        dataframes.append(pd.DataFrame(columns))
+
+    sr = key_statistics["Success Rate"][0]
+    reached = np.flatnonzero(sr >= 0.9)
+    if len(reached) > 0:
+        print(
+            f"Key success rate reaches 90% after {(reached[0] + 1) * block_size} traces"
+        )
+    else:
+        print(f"Final key success rate = {sr[-1]:0.2f}")
+
+    result = pd.concat(dataframes)
+
+    result.to_csv(output_filename)
+
+
+@app.command()
+def collision_attack(
+    data_filename: Path,
+    config_filename: Path,
+    output_filename: Path,
+    corr_filename: Annotated[
+        Optional[Path],
+        typer.Option(help="Correlation results ranking the candidate keys"),
+    ] = None,
+    key: Annotated[
+        Optional[str], typer.Option(help="The round key, if known, to check results")
+    ] = None,
+) -> None:
+    """Find the relations between key bytes with a correlation-enhanced collision attack.
+
+    Mean traces are accumulated for each value of each plaintext byte, and the ones
+    of every pair of bytes are correlated for all the deltas k_i ^ k_j. No leakage
+    model is needed. The relations leave 256 candidate keys, ranked with the
+    correlation results of a (partial) CPA when given.
+
+    The collision scores are stored, shaped (16, 16, 256), along with a CSV of
+    the candidate keys next to the output file.
+    """
+    config = load_config(config_filename)
+    _require_shared_poi(config)
+    signal_preprocessor = SignalPreprocessor(config)
+
+    raw_key = None
+    if key is not None:
+        raw_key = unhexlify(key)
+        if len(raw_key) != 16:
+            raise typer.BadParameter(
+                "The size of the round key is expected to be 16 bytes"
+            )
+
+    data_f = zarr.open(data_filename, "r")
+
+    samples_array = data_f["samples"]
+    payloads_array = data_f["payloads"]
+
+    chunk_size = data_f["samples"].chunks[0]
+    n_measurements = (payloads_array.shape[0] // chunk_size) * chunk_size
+
+    solver = cpa_lib.CollisionSolver()
+
+    for i in track(range(0, n_measurements, chunk_size)):
+        chunk = samples_array[i : i + chunk_size][:, :, : required_samples(config)]
+
+        # Don't forget to flip the plaintext (ESP32 implementation detail)
+        plaintext = np.flip(
+            payloads_array[i : i + chunk_size],
+            axis=1,
+        )
+
+        temperatures = _chunk_temperatures(data_f, [config], i, i + chunk_size)
+        solver.update(plaintext, signal_preprocessor.process(chunk, temperatures))
+
+    scores = solver.get_result()
+    result = zarr.open(output_filename, mode="w-", shape=scores.shape, dtype="f")
+    result[:] = scores
+
+    deltas, margins = resolve_deltas(scores)
+    for j in range(1, 16):
+        print(f"k0 ^ k{j} = 0x{deltas[j]:02x} (margin {margins[j]:0.4f})")
+
+    log_likelihoods = None
+    if corr_filename is not None:
+        corr = zarr.open(corr_filename, "r")
+        _require_correlations(corr)
+        n_steps = corr.shape[1]
+        log_likelihoods = correlation_log_likelihoods(
+            np.array(corr[:, n_steps - 1]), n_measurements
+        )
+    keys, key_scores = candidate_keys(deltas, log_likelihoods)
+
+    if raw_key is not None:
+        right_key = np.frombuffer(raw_key, dtype=np.uint8)
+        right_deltas = right_key[0] ^ right_key
+        print(f"Right relations: {np.sum(deltas[1:] == right_deltas[1:])}/15")
+        matches = np.flatnonzero(np.all(keys == right_key[None], axis=1))
+        if len(matches) > 0:
+            print(f"Key rank among the candidates = {matches[0]}")
+
+    pd.DataFrame(
+        {
+            "Rank": np.arange(len(keys)),
+            "Key": [bytes(k).hex() for k in keys],
+            "Score": key_scores,
+        }
+    ).to_csv(output_filename.with_suffix(".csv"), index=False)
+
+
+@app.command()
+def estimate_full_key_rank(
+    corr_filename: Path,
+    key: str,
+    output_filename: Path,
+    n_bins: int = 2048,
+) -> None:
+    """Estimate the full key rank (log2 of the remaining brute force effort), given a known round key."""
+    corr = zarr.open(corr_filename, "r")
+    _require_correlations(corr)
+    chunk_size = corr.attrs.get("chunk_size", 5000)
+
+    raw_key = unhexlify(key)
+    if len(raw_key) != 16:
+        raise typer.BadParameter("The size of the round key is expected to be 16 bytes")
+
+    rank_result = np.zeros((corr.shape[1], 3))
+
+    for step in range(corr.shape[1]):
+        log_likelihoods = correlation_log_likelihoods(
+            np.array(corr[:, step]), (step + 1) * chunk_size
+        )
+        rank_result[step] = estimate_key_rank(log_likelihoods, raw_key, n_bins)
+
+    lower, estimate, upper = rank_result[-1]
+    print(f"Final full key rank = 2^{estimate:0.1f} (2^{lower:0.1f} - 2^{upper:0.1f})")
+
+    dataframes = []
+    for i, name in enumerate(("Lower Bound", "Estimate", "Upper Bound")):
+        df = pd.DataFrame(
+            {
+                "Measurement Index": np.arange(
+                    0, rank_result.shape[0] * chunk_size, chunk_size
+                ),
+                "Rank": rank_result[:, i],
+                "Name": name,
+            }
+        )
+        dataframes.append(df)
+
+    result = pd.concat(dataframes)
+
+    result.to_csv(output_filename)
+
+
 @app.command()
 def find_best_poi(corr_filename: Path, key: str) -> None:
     """Find the best POI."""
@@ -541,6 +1757,7 @@ def leakage_assessment(
 ) -> None:
     """Perform a leakage assessment (ESP32-C3 or ESP32-C6 targets)."""
     config = load_config(config_filename)
+    _require_shared_poi(config)
     signal_preprocessor = SignalPreprocessor(config)
 
     data_f = zarr.open(data_filename, "r")
@@ -581,7 +1798,8 @@ def leakage_assessment(
             axis=1,
         )
 
-        sig = signal_preprocessor.process(chunk)
+        temperatures = _chunk_temperatures(data_f, [config], i, i + chunk_size)
+        sig = signal_preprocessor.process(chunk, temperatures)
 
         solver.update(plaintext, sig)
 
@@ -0,0 +1,193 @@
+// Benchmarks of the hot paths of the analysis.
+//
+// The correlation engine benchmarks need an OpenCL runtime. On a plain Linux
+// box, a CPU implementation such as pocl is enough:
+//
+//   cargo bench --no-default-features
+
+use criterion::{black_box, criterion_group, criterion_main, BenchmarkId, Criterion, Throughput};
+
+use cpa_lib::aes::compute_all_states;
+use cpa_lib::correlation_engine::OpenclCorrelationEngine;
+use cpa_lib::power_consumption_models::{
+    ConsumptionModelRound0, ConsumptionModelRound0DecTable, ConsumptionModelRound1,
+    ConsumptionModelRound1DecTable, ConsumptionModelTrait,
+};
+use cpa_lib::sample_codec;
+
+const CHUNK_SIZES: [usize; 2] = [1000, 5000];
+const DURATIONS: [usize; 3] = [1, 16, 64];
+const N_GUESSES: [usize; 2] = [256, 1024];
+
+// Deterministic pseudo-random data, so that runs can be compared
+struct Rng(u64);
+
+impl Rng {
+    fn next(&mut self) -> u64 {
+        self.0 ^= self.0 << 13;
+        self.0 ^= self.0 >> 7;
+        self.0 ^= self.0 << 17;
+        self.0
+    }
+
+    fn payload(&mut self) -> [u8; 16] {
+        let mut payload = [0u8; 16];
+        for b in payload.iter_mut() {
+            *b = self.next() as u8;
+        }
+        payload
+    }
+
+    fn sample(&mut self) -> f64 {
+        (self.next() >> 11) as f64 / (1u64 << 53) as f64
+    }
+}
+
+fn payloads(n: usize) -> Vec<[u8; 16]> {
+    let mut rng = Rng(1);
+    (0..n).map(|_| rng.payload()).collect()
+}
+
+// Same layout as the CpaSolver inputs: one row per sample (POI), one row per guess
+fn engine_inputs(
+    chunk_size: usize,
+    duration: usize,
+    n_guesses: usize,
+) -> (Vec<Vec<f64>>, Vec<Vec<f64>>) {
+    let mut rng = Rng(2);
+    let samples = (0..duration)
+        .map(|_| (0..chunk_size).map(|_| rng.sample()).collect())
+        .collect();
+    let guesses = (0..n_guesses)
+        .map(|_| (0..chunk_size).map(|_| (rng.next() % 9) as f64).collect())
+        .collect();
+    (samples, guesses)
+}
+
+fn bench_correlation_engine(c: &mut Criterion) {
+    let mut group = c.benchmark_group("correlation_engine_update");
+    group.sample_size(10);
+    for &chunk_size in CHUNK_SIZES.iter() {
+        for &duration in DURATIONS.iter() {
+            for &n_guesses in N_GUESSES.iter() {
+                let (samples, guesses) = engine_inputs(chunk_size, duration, n_guesses);
+                let mut engine = OpenclCorrelationEngine::new(duration, n_guesses).unwrap();
+
+                group.throughput(Throughput::Elements(chunk_size as u64));
+                group.bench_with_input(
+                    BenchmarkId::from_parameter(format!(
+                        "chunk={}/n_poi={}/guesses={}",
+                        chunk_size, duration, n_guesses
+                    )),
+                    &(samples, guesses),
+                    |b, (samples, guesses)| {
+                        b.iter(|| engine.update(samples.clone(), guesses.clone()).unwrap())
+                    },
+                );
+            }
+        }
+    }
+    group.finish();
+
+    let mut group = c.benchmark_group("correlation_engine_get_result");
+    for &duration in DURATIONS.iter() {
+        for &n_guesses in N_GUESSES.iter() {
+            let (samples, guesses) = engine_inputs(1000, duration, n_guesses);
+            let mut engine = OpenclCorrelationEngine::new(duration, n_guesses).unwrap();
+            engine.update(samples, guesses).unwrap();
+
+            group.bench_function(
+                BenchmarkId::from_parameter(format!("n_poi={}/guesses={}", duration, n_guesses)),
+                |b| b.iter(|| black_box(engine.get_result().unwrap())),
+            );
+        }
+    }
+    group.finish();
+}
+
+fn bench_models(c: &mut Criterion) {
+    let key = [0x2bu8; 16];
+    let models: Vec<(&str, Box<dyn ConsumptionModelTrait>)> = vec![
+        ("round0", Box::new(ConsumptionModelRound0::new(1.0))),
+        ("round0dectable", Box::new(ConsumptionModelRound0DecTable::new(1.0))),
+        ("round1", Box::new(ConsumptionModelRound1::new(&key, 1.0))),
+        (
+            "round1dectable",
+            Box::new(ConsumptionModelRound1DecTable::new(&key, 1.0)),
+        ),
+    ];
+
+    // Hypotheses for all the guesses, the way CpaSolver::update generates them
+    let mut group = c.benchmark_group("model_hypotheses");
+    for &chunk_size in CHUNK_SIZES.iter() {
+        let payloads = payloads(chunk_size);
+        group.throughput(Throughput::Elements(chunk_size as u64));
+        for (name, model) in models.iter() {
+            group.bench_with_input(
+                BenchmarkId::new(*name, chunk_size),
+                &payloads,
+                |b, payloads| {
+                    b.iter(|| {
+                        let guesses: Vec<Vec<f64>> = (0..=u8::MAX)
+                            .map(|i| payloads.iter().map(|p| model.estimate(p, i, 5)).collect())
+                            .collect();
+                        black_box(guesses)
+                    })
+                },
+            );
+        }
+    }
+    group.finish();
+}
+
+fn bench_aes(c: &mut Criterion) {
+    let keys: Vec<[u8; 16]> = (0..11).map(|i| [i as u8; 16]).collect();
+
+    let mut group = c.benchmark_group("aes_compute_all_states");
+    for &chunk_size in CHUNK_SIZES.iter() {
+        let payloads = payloads(chunk_size);
+        group.throughput(Throughput::Elements(chunk_size as u64));
+        group.bench_with_input(
+            BenchmarkId::from_parameter(chunk_size),
+            &payloads,
+            |b, payloads| {
+                b.iter(|| {
+                    for p in payloads.iter() {
+                        black_box(compute_all_states(p, &keys));
+                    }
+                })
+            },
+        );
+    }
+    group.finish();
+}
+
+// One measurements.zarr chunk: 5000 traces, 4 averaged measurements of 768
+// noisy 12-bit samples
+fn bench_sample_codec(c: &mut Criterion) {
+    let mut rng = Rng(3);
+    let samples: Vec<i16> = (0..5000 * 4 * 768)
+        .map(|i| ((i % 768) as f64 * 0.05).sin() * 800.0 + rng.sample() * 40.0)
+        .map(|v| v as i16)
+        .collect();
+    let encoded = sample_codec::encode(&samples);
+
+    let mut group = c.benchmark_group("sample_codec");
+    group.throughput(Throughput::Elements(samples.len() as u64));
+    group.bench_function("encode", |b| {
+        b.iter(|| black_box(sample_codec::encode(&samples)))
+    });
+    group.bench_function("decode", |b| {
+        b.iter(|| black_box(sample_codec::decode(&encoded).unwrap()))
+    });
+    group.finish();
+}
+
+criterion_group!(
+    benches,
+    bench_correlation_engine,
+    bench_models,
+    bench_aes,
+    bench_sample_codec
+);
+criterion_main!(benches);
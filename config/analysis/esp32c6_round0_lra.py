@@ -0,0 +1,20 @@
+"""Configuration file for ESP32C6, first round, linear regression analysis."""
+
+
+# Pre-processing filter parameters
+f_type = "band"
+f_order = 8
+f_cutoff = (
+    0.35e6,
+    0.80e6,
+)
+drift_compensation = True
+
+# POI selection
+poi = [345]
+
+# Leakage model, the weight of each bit of the intermediate value is learnt
+solver = "lra"
+model = "round0dectable"
+model_beta_modifier = None
+model_args = None
@@ -0,0 +1,22 @@
+"""Configuration file for ESP32C6, first round, mutual information analysis."""
+
+
+# Pre-processing filter parameters
+f_type = "band"
+f_order = 8
+f_cutoff = (
+    0.35e6,
+    0.80e6,
+)
+drift_compensation = True
+
+# POI selection
+poi = [345]
+
+# Leakage model, only the Hamming weight classes of the intermediate value are
+# used, whatever the shape of the leakage
+solver = "mia"
+mia_bins = 16
+model = "round0dectable"
+model_beta_modifier = None
+model_args = None
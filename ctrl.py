@@ -3,6 +3,7 @@
 
 from pathlib import Path
 from types import SimpleNamespace
+from typing import Optional
 
 import typer
 from typing_extensions import Annotated
@@ -16,14 +17,14 @@ app = typer.Typer()
 def configure_board(ctx: typer.Context) -> None:
     """Configure the board, with both firmware and gateware."""
     config = load_config(ctx.obj.measurement_config)
-    board = EspCpaBoard(config)
+    board = EspCpaBoard(config, device=ctx.obj.device)
     board.configure()
 
 
 @app.command()
 def set_dut_power(ctx: typer.Context, power: bool) -> None:
     """Control the DUT power supply."""
-    board = EspCpaBoard(ctx.obj.measurement_config)
+    board = EspCpaBoard(ctx.obj.measurement_config, device=ctx.obj.device)
     board.connect()
     board.set_dut_power(power)
 
@@ -31,7 +32,7 @@ def set_dut_power(ctx: typer.Context, power: bool) -> None:
 @app.command()
 def enable_dut_clock(ctx: typer.Context) -> None:
     """Enable the DUT clock."""
-    board = EspCpaBoard(ctx.obj.measurement_config)
+    board = EspCpaBoard(ctx.obj.measurement_config, device=ctx.obj.device)
     board.connect()
     board.set_clk_en(True)
 
@@ -39,7 +40,7 @@ def enable_dut_clock(ctx: typer.Context) -> None:
 @app.command()
 def disable_dut_clock(ctx: typer.Context) -> None:
     """Disable the DUT clock."""
-    board = EspCpaBoard(ctx.obj.measurement_config)
+    board = EspCpaBoard(ctx.obj.measurement_config, device=ctx.obj.device)
     board.connect()
     board.set_clk_en(False)
 
@@ -47,7 +48,7 @@ def disable_dut_clock(ctx: typer.Context) -> None:
 @app.command()
 def get_temperature(ctx: typer.Context) -> None:
     """Get the temperature read by the cartridge sensor."""
-    board = EspCpaBoard(ctx.obj.measurement_config)
+    board = EspCpaBoard(ctx.obj.measurement_config, device=ctx.obj.device)
     board.connect()
     temperature = board.get_temperature()
     print(f"{temperature = :.2f} °C")
@@ -66,18 +67,29 @@ def set_heater_pwm(
     ],
 ) -> None:
     """Set the cardtrige heater PWM value."""
-    board = EspCpaBoard(ctx.obj.measurement_config)
+    board = EspCpaBoard(ctx.obj.measurement_config, device=ctx.obj.device)
     board.connect()
     board.set_heater_pwm(value)
 
 
+@app.command()
+def list_boards() -> None:
+    """List the connected boards."""
+    for path, serial in EspCpaBoard.list_devices():
+        print(f"{path}\t{serial or '-'}")
+
+
 @app.callback()
 def main(
     ctx: typer.Context,
     measurement_config: Path,
+    device: Annotated[
+        Optional[str],
+        typer.Option(help="Bus path or serial number of the board, see list-boards"),
+    ] = None,
 ):
     """Control and configuration tools for the ESP CPA Board."""
-    ctx.obj = SimpleNamespace(measurement_config=measurement_config)
+    ctx.obj = SimpleNamespace(measurement_config=measurement_config, device=device)
 
 
 if __name__ == "__main__":
@@ -9,9 +9,11 @@ __all__ = [
     "load_config",
     "SignalPreprocessor",
     "LiveSignalViewer",
+    "SampleCodec",
 ]
 
 from .esp_cpa_board import EspCpaBoard, EspCpaBoardError
 from .live_signal_viewer import LiveSignalViewer
+from .sample_codec import SampleCodec
 from .temp_controller import TempController, TempMonitorThread
 from .utils import SignalPreprocessor, load_config
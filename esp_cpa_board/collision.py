@@ -0,0 +1,64 @@
+#!/usr/bin/env python3
+"""Resolution of the key byte relations found by collision attacks."""
+
+from typing import Optional, Tuple
+
+import numpy as np
+
+
+def resolve_deltas(scores: np.ndarray) -> Tuple[np.ndarray, np.ndarray]:
+    """Derive k_0 ^ k_j for each byte j from the pairwise collision scores.
+
+    The margin between the best and second best delta of each pair measures how
+    trustworthy the pair is. Deltas are chained along the maximum spanning tree of
+    the margins, so that the 15 relations needed come from the most reliable pairs.
+
+    Args:
+        scores (np.ndarray): Collision score of each delta, shaped (16, 16, 256)
+
+    Returns:
+        Tuple[np.ndarray, np.ndarray]: k_0 ^ k_j for each byte, and the smallest margin along its path to byte 0
+    """
+    n_bytes = scores.shape[0]
+    ordered = np.sort(scores, axis=2)
+    margins = ordered[:, :, -1] - ordered[:, :, -2]
+    best_deltas = np.argmax(scores, axis=2)
+
+    # Prim's algorithm, rooted at byte 0
+    deltas = np.zeros(n_bytes, dtype=np.uint8)
+    weakest = np.full(n_bytes, np.inf)
+    in_tree = np.zeros(n_bytes, dtype=bool)
+    in_tree[0] = True
+    while not np.all(in_tree):
+        candidates = np.where(in_tree[:, None] & ~in_tree[None, :], margins, -np.inf)
+        i, j = np.unravel_index(np.argmax(candidates), candidates.shape)
+        deltas[j] = deltas[i] ^ best_deltas[i, j]
+        weakest[j] = min(weakest[i], margins[i, j])
+        in_tree[j] = True
+
+    return deltas, weakest
+
+
+def candidate_keys(
+    deltas: np.ndarray, log_likelihoods: Optional[np.ndarray] = None
+) -> Tuple[np.ndarray, np.ndarray]:
+    """List the 256 keys consistent with the byte relations.
+
+    With per-byte log-likelihoods (e.g. from a partial CPA), candidates are sorted
+    from the most to the least likely.
+
+    Args:
+        deltas (np.ndarray): k_0 ^ k_j for each byte, see `resolve_deltas`
+        log_likelihoods (Optional[np.ndarray]): Log-likelihoods, shaped (n_bytes, 256). Defaults to None.
+
+    Returns:
+        Tuple[np.ndarray, np.ndarray]: The candidate keys, shaped (256, n_bytes), and their scores
+    """
+    keys = np.arange(256, dtype=np.uint8)[:, None] ^ deltas[None, :]
+
+    if log_likelihoods is None:
+        return keys, np.zeros(256)
+
+    scores = np.sum(log_likelihoods[np.arange(keys.shape[1])[None, :], keys], axis=1)
+    order = np.argsort(-scores)
+    return keys[order], scores[order]
@@ -0,0 +1,139 @@
+#!/usr/bin/env python3
+"""Convergence monitoring of correlation campaigns."""
+
+from typing import List, Optional
+
+import numpy as np
+
+
+class ConvergenceMonitor:
+    """Decide when the best guess of each key byte is settled.
+
+    A byte is converged when its best guess has been the same for stable_steps
+    consecutive updates, and when the margin between its best and second best
+    correlation values is large enough. The margin is the difference of their
+    Fisher z-transforms, in units of standard deviation (sqrt(2 / (n - 3))).
+
+    Optionally, the confidence of the best guess is estimated with a parametric
+    bootstrap: z-transformed correlation values are redrawn from their sampling
+    distribution, and the fraction of draws in which the best guess stays the best
+    must reach the requested confidence.
+    """
+
+    def __init__(
+        self,
+        min_margin: float = 5.0,
+        stable_steps: int = 10,
+        confidence: Optional[float] = None,
+        n_bootstrap: int = 1000,
+    ) -> None:
+        """Instantiate a ConvergenceMonitor object.
+
+        Args:
+            min_margin (float): Minimum margin, in standard deviations. Defaults to 5.0.
+            stable_steps (int): Number of updates the best guess must stay the same for. Defaults to 10.
+            confidence (Optional[float]): Minimum bootstrap confidence. Defaults to None (disabled).
+            n_bootstrap (int): Number of bootstrap draws. Defaults to 1000.
+        """
+        self._min_margin = min_margin
+        self._stable_steps = stable_steps
+        self._confidence = confidence
+        self._n_bootstrap = n_bootstrap
+
+        self._rng = np.random.default_rng()
+        self._best_guesses: Optional[np.ndarray] = None
+        self._stable_counts: Optional[np.ndarray] = None
+        self._margins: Optional[np.ndarray] = None
+        self._confidences: Optional[np.ndarray] = None
+
+    def update(self, scores: np.ndarray, n_traces: int) -> bool:
+        """Update the monitor with the latest correlation values.
+
+        Args:
+            scores (np.ndarray): Best absolute correlation value of each guess, shaped (n_bytes, 256)
+            n_traces (int): The number of traces the correlation values are based on
+
+        Returns:
+            bool: True if all the bytes are converged
+        """
+        n_bytes = scores.shape[0]
+        sigma = np.sqrt(1 / max(n_traces - 3, 1))
+
+        z = np.arctanh(np.clip(scores, 0.0, 1.0 - 1e-12))
+        order = np.argsort(-z, axis=1)
+        best_guesses = order[:, 0]
+        z_best = z[np.arange(n_bytes), order[:, 0]]
+        z_second = z[np.arange(n_bytes), order[:, 1]]
+
+        if self._best_guesses is None or self._stable_counts is None:
+            self._stable_counts = np.zeros(n_bytes, dtype=int)
+        else:
+            same = best_guesses == self._best_guesses
+            self._stable_counts = np.where(same, self._stable_counts + 1, 0)
+        self._best_guesses = best_guesses
+
+        self._margins = (z_best - z_second) / (np.sqrt(2) * sigma)
+
+        if self._confidence is not None:
+            draws = z[None] + self._rng.normal(
+                0.0, sigma, size=(self._n_bootstrap,) + z.shape
+            )
+            self._confidences = np.mean(
+                np.argmax(draws, axis=2) == best_guesses[None], axis=0
+            )
+
+        return self.converged
+
+    @property
+    def converged(self) -> bool:
+        """Check if all the bytes are converged.
+
+        Returns:
+            bool: True if all the bytes are converged
+        """
+        converged_bytes = self.converged_bytes
+        return len(converged_bytes) > 0 and bool(np.all(converged_bytes))
+
+    @property
+    def converged_bytes(self) -> np.ndarray:
+        """Get the convergence status of each byte.
+
+        Returns:
+            np.ndarray: A boolean array, True for converged bytes
+        """
+        if self._stable_counts is None or self._margins is None:
+            return np.zeros(0, dtype=bool)
+
+        converged = (self._stable_counts >= self._stable_steps) & (
+            self._margins >= self._min_margin
+        )
+        if self._confidence is not None and self._confidences is not None:
+            converged &= self._confidences >= self._confidence
+        return converged
+
+    @property
+    def best_guesses(self) -> List[int]:
+        """Get the current best guess of each byte.
+
+        Returns:
+            List[int]: The best guesses
+        """
+        if self._best_guesses is None:
+            return []
+        return [int(g) for g in self._best_guesses]
+
+    def status(self) -> str:
+        """Get a human readable convergence status.
+
+        Returns:
+            str: The status
+        """
+        if self._margins is None:
+            return "No data"
+        status = (
+            f"Converged bytes = {np.count_nonzero(self.converged_bytes)}/"
+            f"{len(self._margins)}, min margin = {np.min(self._margins):0.2f}"
+        )
+        if self._confidences is not None:
+            status += f", min confidence = {np.min(self._confidences):0.3f}"
+        return status
@@ -0,0 +1,112 @@
+#!/usr/bin/env python3
+"""Downsampling of long series before plotting."""
+
+from typing import Tuple
+
+import numpy as np
+
+
+def lttb_indexes(x: np.ndarray, y: np.ndarray, n_out: int) -> np.ndarray:
+    """Select points with the Largest-Triangle-Three-Buckets algorithm.
+
+    The points between the first and the last one are split into n_out - 2 buckets.
+    In each bucket, the point forming the largest triangle with the previously
+    selected point and the average of the next bucket is kept, which preserves the
+    visual shape of the series (peaks included). Several series sharing the same x
+    coordinates are processed at once.
+
+    Args:
+        x (np.ndarray): The x coordinates, shaped (n,), increasing
+        y (np.ndarray): The y coordinates, shaped (n_series, n)
+        n_out (int): Number of points to keep per series
+
+    Returns:
+        np.ndarray: Indexes of the kept points, shaped (n_series, min(n, n_out))
+    """
+    n_series, n = y.shape
+    if n <= n_out or n_out < 3:
+        return np.tile(np.arange(n), (n_series, 1))
+
+    x = np.asarray(x, dtype=np.float64)
+    y = np.asarray(y, dtype=np.float64)
+    rows = np.arange(n_series)
+    edges = np.linspace(1, n - 1, n_out - 1).astype(int)
+
+    indexes = np.zeros((n_series, n_out), dtype=int)
+    indexes[:, -1] = n - 1
+    for i in range(n_out - 2):
+        bucket = slice(edges[i], edges[i + 1])
+        following = (
+            slice(edges[i + 1], edges[i + 2]) if i < n_out - 3 else slice(n - 1, n)
+        )
+        avg_x = np.mean(x[following])
+        avg_y = np.mean(y[:, following], axis=1, keepdims=True)
+
+        a = indexes[:, i]
+        a_x = x[a][:, None]
+        a_y = y[rows, a][:, None]
+        areas = np.abs(
+            (a_x - avg_x) * (y[:, bucket] - a_y)
+            - (a_x - x[None, bucket]) * (avg_y - a_y)
+        )
+        indexes[:, i + 1] = edges[i] + np.argmax(areas, axis=1)
+
+    return indexes
+
+
+def min_max_indexes(y: np.ndarray, n_out: int) -> np.ndarray:
+    """Select the minimum and the maximum of each bucket of points.
+
+    The envelope of the series is kept exactly, which suits noisy series whose
+    extremes matter more than their shape.
+
+    Args:
+        y (np.ndarray): The y coordinates, shaped (n_series, n)
+        n_out (int): Number of points to keep per series, two per bucket
+
+    Returns:
+        np.ndarray: Indexes of the kept points, in increasing order, shaped
+            (n_series, min(n, n_out // 2 * 2))
+    """
+    n_series, n = y.shape
+    n_buckets = n_out // 2
+    if n <= n_out or n_buckets < 1:
+        return np.tile(np.arange(n), (n_series, 1))
+
+    edges = np.linspace(0, n, n_buckets + 1).astype(int)
+    indexes = np.zeros((n_series, 2 * n_buckets), dtype=int)
+    for i in range(n_buckets):
+        bucket = y[:, edges[i] : edges[i + 1]]
+        extremes = np.stack(
+            [np.argmin(bucket, axis=1), np.argmax(bucket, axis=1)], axis=1
+        )
+        indexes[:, 2 * i : 2 * i + 2] = edges[i] + np.sort(extremes, axis=1)
+
+    return indexes
+
+
+def downsample(
+    x: np.ndarray, y: np.ndarray, n_out: int, method: str = "lttb"
+) -> Tuple[np.ndarray, np.ndarray]:
+    """Downsample several series sharing the same x coordinates.
+
+    Args:
+        x (np.ndarray): The x coordinates, shaped (n,), increasing
+        y (np.ndarray): The y coordinates, shaped (n_series, n)
+        n_out (int): Number of points to keep per series
+        method (str): "lttb", "minmax", or "none" to keep all the points. Defaults to "lttb".
+
+    Returns:
+        Tuple[np.ndarray, np.ndarray]: The x and y coordinates of the kept points,
+            both shaped (n_series, n_kept)
+    """
+    if method == "lttb":
+        indexes = lttb_indexes(x, y, n_out)
+    elif method == "minmax":
+        indexes = min_max_indexes(y, n_out)
+    elif method == "none":
+        indexes = np.tile(np.arange(y.shape[1]), (y.shape[0], 1))
+    else:
+        raise ValueError(f"Unknown downsampling method {method}")
+
+    return np.asarray(x)[indexes], np.take_along_axis(y, indexes, axis=1)
@@ -0,0 +1,123 @@
+#!/usr/bin/env python3
+"""Streaming compensation of the slow drift of the POI values."""
+
+from typing import Any, Optional
+
+import numpy as np
+from scipy import signal
+
+TEMPERATURE_RATE = 100  # One temperature point is recorded each TEMPERATURE_RATE traces
+
+
+def interpolate_temperatures(
+    temperatures: Any, start: int, stop: int, rate: int = TEMPERATURE_RATE
+) -> Optional[np.ndarray]:
+    """Get the temperature of each trace of a range, from the recorded points.
+
+    Args:
+        temperatures (Any): The recorded temperatures (zarr or numpy array)
+        start (int): Index of the first trace
+        stop (int): Index after the last trace
+        rate (int): Number of traces per temperature point. Defaults to TEMPERATURE_RATE.
+
+    Returns:
+        Optional[np.ndarray]: The temperatures, None if no temperature was recorded
+    """
+    n_points = temperatures.shape[0]
+    if n_points == 0:
+        return None
+
+    first = min(start // rate, n_points - 1)
+    last = min(stop // rate + 2, n_points)
+    points = np.asarray(temperatures[first:last], dtype=np.float64)
+
+    return np.interp(np.arange(start, stop), np.arange(first, last) * rate, points)
+
+
+class DriftCompensator:
+    """Remove the slow drift of the POI values, across chunk boundaries.
+
+    The POI values are regressed on the DUT temperature, with least squares
+    statistics accumulated over all the traces seen so far. What remains of the
+    drift once the temperature term is removed is tracked by a running baseline
+    (exponential moving average, with a time constant of window traces), which is
+    subtracted as well.
+    """
+
+    def __init__(self, window: int = 1000) -> None:
+        """Instantiate a DriftCompensator object.
+
+        Args:
+            window (int): Time constant of the running baseline, in traces. Defaults to 1000.
+        """
+        alpha = 2.0 / (window + 1)
+        self._b = np.array([alpha])
+        self._a = np.array([1.0, alpha - 1.0])
+
+        self._zi: Optional[np.ndarray] = None
+
+        # Least squares statistics of the POI values against the temperature,
+        # relative to the first temperature for numerical stability
+        self._t0: Optional[float] = None
+        self._n = 0
+        self._sum_t = 0.0
+        self._sum_tt = 0.0
+        self._sum_x: Optional[np.ndarray] = None
+        self._sum_xt: Optional[np.ndarray] = None
+
+    @property
+    def temperature_coefficients(self) -> Optional[np.ndarray]:
+        """Get the temperature coefficient of each POI.
+
+        Returns:
+            Optional[np.ndarray]: The coefficients, None until temperatures are fed
+        """
+        if self._sum_x is None or self._sum_xt is None:
+            return None
+
+        var_t = self._sum_tt - self._sum_t**2 / self._n
+        if var_t <= 1e-12 * max(self._sum_tt, 1.0):
+            return np.zeros_like(self._sum_x)
+        return (self._sum_xt - self._sum_x * self._sum_t / self._n) / var_t
+
+    def process(
+        self, samples: np.ndarray, temperatures: Optional[np.ndarray] = None
+    ) -> np.ndarray:
+        """Compensate the drift of a chunk of POI values.
+
+        Args:
+            samples (np.ndarray): The POI values, one trace per row
+            temperatures (Optional[np.ndarray]): The temperature of each trace. Defaults to None (running baseline only).
+
+        Returns:
+            np.ndarray: The compensated POI values
+        """
+        samples = np.asarray(samples, dtype=np.float64)
+
+        if temperatures is not None:
+            t = np.asarray(temperatures, dtype=np.float64)[:, None]
+            if self._t0 is None:
+                self._t0 = float(t[0, 0])
+            t = t - self._t0
+            if self._sum_x is None or self._sum_xt is None:
+                self._sum_x = np.zeros(samples.shape[1])
+                self._sum_xt = np.zeros(samples.shape[1])
+            self._n += samples.shape[0]
+            self._sum_t += float(np.sum(t))
+            self._sum_tt += float(np.sum(t**2))
+            self._sum_x += np.sum(samples, axis=0)
+            self._sum_xt += np.sum(samples * t, axis=0)
+
+            coefficients = self.temperature_coefficients
+            assert coefficients is not None
+            samples = samples - coefficients[None] * t
+
+        if self._zi is None:
+            # Start from a steady state on the first trace
+            self._zi = (1.0 - self._b[0]) * samples[:1]
+
+        baseline, self._zi = signal.lfilter(
+            self._b, self._a, samples, axis=0, zi=self._zi
+        )
+
+        return samples - baseline
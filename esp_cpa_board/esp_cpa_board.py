@@ -8,7 +8,7 @@ import time
 from enum import IntEnum
 from pathlib import Path
 from threading import RLock
-from typing import Any, Callable, Dict, Optional
+from typing import Any, Callable, Dict, List, Optional, Tuple
 
 import fx2.format
 import numpy as np
@@ -66,22 +66,79 @@ def sign_extend(value: int, bits: int) -> int:
     return (value & (sign_bit - 1)) - (value & sign_bit)
 
 
+VENDOR_ID = 0x04B4
+PRODUCT_ID = 0x8613
+
+
+def _bus_path(device: usb1.USBDevice) -> str:
+    """Get the bus path of a USB device, as in sysfs (bus-port.port...).
+
+    Args:
+        device (usb1.USBDevice): The device
+
+    Returns:
+        str: The bus path
+    """
+    ports = ".".join(str(p) for p in device.getPortNumberList())
+    return f"{device.getBusNumber()}-{ports}"
+
+
+def _serial_number(device: usb1.USBDevice) -> Optional[str]:
+    """Get the serial number of a USB device.
+
+    Args:
+        device (usb1.USBDevice): The device
+
+    Returns:
+        Optional[str]: The serial number, None if it cannot be read
+    """
+    try:
+        return device.getSerialNumber()
+    except usb1.USBError:
+        return None
+
+
 class EspCpaBoard:
     """Main EspCpaBoard class."""
 
     def __init__(
-        self, config: Dict[str, Any], firmware_path: Path = Path("./firmware")
+        self,
+        config: Dict[str, Any],
+        firmware_path: Path = Path("./firmware"),
+        device: Optional[str] = None,
     ) -> None:
         """Initialize the class.
 
         Args:
             config: A dictionary containing configuration parameters.
             firmware_path (path): Path to the firmware directory. Default is "./firmware".
+            device (Optional[str]): Bus path (e.g. "1-2.3") or serial number of the board, see `list_devices`. Defaults to None (first board found).
         """
         self._firmware_path = firmware_path
         self._usb_ctx = usb1.USBContext()
         self._mutex = RLock()
         self._config = config
+        self._device = device
+
+    @staticmethod
+    def list_devices() -> List[Tuple[str, Optional[str]]]:
+        """List the connected boards.
+
+        Returns:
+            List[Tuple[str, Optional[str]]]: The bus path and serial number of each board
+        """
+        with usb1.USBContext() as ctx:
+            return [
+                (_bus_path(device), _serial_number(device))
+                for device in ctx.getDeviceIterator(skip_on_error=True)
+                if device.getVendorID() == VENDOR_ID
+                and device.getProductID() == PRODUCT_ID
+            ]
+
+    @property
+    def device(self) -> Optional[str]:
+        """Get the identifier of the board, as given to the constructor."""
+        return self._device
 
     @staticmethod
     def _lock(func: Callable) -> Callable:
@@ -164,7 +221,7 @@ class EspCpaBoard:
     def configure(self) -> None:
         """Configure a board (firmware + gateware)."""
         firmware_data = self._get_fx2_firmware_data()
-        device = FX2Device(vendor_id=0x04B4, product_id=0x8613)
+        device = FX2Device(vendor_id=VENDOR_ID, product_id=PRODUCT_ID)
         device.load_ram(firmware_data)
         time.sleep(1.5)  # Wait a bit to be sure device has been enumerated
         self.connect()
@@ -203,9 +260,21 @@ class EspCpaBoard:
     @_lock
     def connect(self) -> None:
         """Connect to the board control interface."""
-        self._usb_handle = self._usb_ctx.openByVendorIDAndProductID(
-            vendor_id=0x04B4, product_id=0x8613, skip_on_error=True
-        )
+        if self._device is None:
+            self._usb_handle = self._usb_ctx.openByVendorIDAndProductID(
+                vendor_id=VENDOR_ID, product_id=PRODUCT_ID, skip_on_error=True
+            )
+        else:
+            self._usb_handle = None
+            for device in self._usb_ctx.getDeviceIterator(skip_on_error=True):
+                if (
+                    device.getVendorID() != VENDOR_ID
+                    or device.getProductID() != PRODUCT_ID
+                ):
+                    continue
+                if self._device in (_bus_path(device), _serial_number(device)):
+                    self._usb_handle = device.open()
+                    break
         if self._usb_handle is None:
             raise EspCpaBoardError("Device not found")
 
@@ -0,0 +1,134 @@
+#!/usr/bin/env python3
+"""Full-key rank estimation and key enumeration helpers."""
+
+import heapq
+from typing import Iterator, Optional, Tuple
+
+import numpy as np
+
+
+def correlation_log_likelihoods(corr: np.ndarray, n_traces: int) -> np.ndarray:
+    """Convert correlation scores to per-byte log-likelihoods.
+
+    The best correlation value of each guess (over all POIs) is mapped through the
+    Fisher z-transform. Under a Gaussian approximation, the log-likelihood of a guess
+    is then proportional to (n_traces - 3) * z ** 2 / 2.
+
+    Args:
+        corr (np.ndarray): Correlation values, shaped (n_bytes, 256, n_poi)
+        n_traces (int): The number of traces the correlation values are based on
+
+    Returns:
+        np.ndarray: The log-likelihoods, shaped (n_bytes, 256)
+    """
+    rho = np.max(np.abs(corr), axis=2)
+    rho = np.clip(rho, 0.0, 1.0 - 1e-12)
+    z = np.arctanh(rho)
+    return (n_traces - 3) * z**2 / 2
+
+
+def estimate_key_rank(
+    log_likelihoods: np.ndarray, key: bytes, n_bins: int = 2048
+) -> Tuple[float, float, float]:
+    """Estimate the rank of a full key with the histogram convolution method.
+
+    The log-likelihoods of each byte are binned on a common grid, and the per-byte
+    histograms are convolved together. The number of keys more likely than the
+    correct one is then read from the resulting histogram. Since each byte adds up
+    to one bin of quantization error, the rank is bounded by shifting the
+    correct key bin by the number of bytes.
+
+    Args:
+        log_likelihoods (np.ndarray): The log-likelihoods, shaped (n_bytes, 256)
+        key (bytes): The correct key
+        n_bins (int): Number of histogram bins per byte. Defaults to 2048.
+
+    Returns:
+        Tuple[float, float, float]: log2 of the lower bound, estimate and upper bound of the key rank
+
+    Example:
+        The key (0, 1) ties with (1, 0) behind (0, 0), so its rank is 2:
+
+        >>> log_likelihoods = np.zeros((2, 256))
+        >>> log_likelihoods[:, 0], log_likelihoods[:, 1] = 2.0, 1.0
+        >>> estimate_key_rank(log_likelihoods, bytes([0, 1]))
+        (0.0, 1.0, 1.584962500721156)
+    """
+    n_bytes = log_likelihoods.shape[0]
+
+    l_min = np.min(log_likelihoods)
+    l_max = np.max(log_likelihoods)
+    width = (l_max - l_min) / n_bins
+    if width == 0.0:
+        width = 1.0
+
+    bins = np.floor((log_likelihoods - l_min) / width).astype(int)
+    bins = np.clip(bins, 0, n_bins - 1)
+
+    hist = np.ones(1)
+    for i in range(n_bytes):
+        byte_hist = np.bincount(bins[i], minlength=n_bins).astype(float)
+        hist = np.convolve(hist, byte_hist)
+
+    key_bin = sum(bins[i, k] for i, k in enumerate(key))
+
+    def _count_above(b: int) -> float:
+        return float(np.sum(hist[max(b, 0) :]))
+
+    # Rank 1 means the correct key is the most likely one
+    lower = max(_count_above(key_bin + n_bytes + 1), 1.0)
+    estimate = max(_count_above(key_bin + 1) + hist[key_bin] / 2, 1.0)
+    upper = max(_count_above(key_bin - n_bytes + 1), 1.0)
+
+    return (float(np.log2(lower)), float(np.log2(estimate)), float(np.log2(upper)))
+
+
+def enumerate_keys(
+    log_likelihoods: np.ndarray, max_candidates: Optional[int] = None
+) -> Iterator[bytes]:
+    """Enumerate full keys in decreasing likelihood order.
+
+    Candidates are described by the rank of each of their bytes. A candidate is
+    generated from a unique parent by incrementing one of the bytes located at or
+    after the last non-zero rank of the parent. Since a parent is always at least
+    as likely as its children, popping candidates from a max-heap yields them in
+    exact likelihood order. With max_candidates, the heap only keeps the candidates
+    that can still be popped, which bounds its size.
+
+    Args:
+        log_likelihoods (np.ndarray): The log-likelihoods, shaped (n_bytes, 256)
+        max_candidates (Optional[int]): Stop after this number of candidates. Defaults to None (no limit).
+
+    Yields:
+        bytes: The key candidates
+    """
+    n_bytes = log_likelihoods.shape[0]
+
+    order = np.argsort(-log_likelihoods, axis=1, kind="stable")
+    sorted_ll = np.take_along_axis(log_likelihoods, order, axis=1).tolist()
+    guesses = order.tolist()
+
+    # Byte ranks are stored as bytes, much smaller than tuples of ints
+    start = bytes(n_bytes)
+    heap = [(-sum(ll[0] for ll in sorted_ll), start, 0)]
+
+    n = 0
+    while heap and (max_candidates is None or n < max_candidates):
+        score, ranks, last = heapq.heappop(heap)
+
+        yield bytes(guesses[i][r] for i, r in enumerate(ranks))
+        n += 1
+
+        for j in range(last, n_bytes):
+            r = ranks[j]
+            if r == 255:
+                continue
+            child = ranks[:j] + bytes((r + 1,)) + ranks[j + 1 :]
+            child_score = score + sorted_ll[j][r] - sorted_ll[j][r + 1]
+            heapq.heappush(heap, (child_score, child, j))
+
+        # Children are less likely than their parents, so the candidates beyond
+        # the remaining budget can be dropped with their whole subtrees. A sorted
+        # list is a valid heap.
+        if max_candidates is not None and len(heap) > 2 * (max_candidates - n):
+            heap = heapq.nsmallest(max_candidates - n, heap)
@@ -2,6 +2,9 @@
 """GUI live viewer of the captured signals."""
 
 import time
+from multiprocessing import resource_tracker
+from multiprocessing.shared_memory import SharedMemory
+from typing import Callable, Optional, Tuple, TypeVar
 
 import numpy as np
 import pyqtgraph as pg
@@ -9,24 +12,232 @@ import pyqtgraph.multiprocess as mp
 
 __all__ = ["LiveSignalViewer"]
 
+T = TypeVar("T")
 
-class LiveSignalViewer:
-    """GUI live viewer of the captured signals."""
 
-    def __init__(self, rate_limit=0.1) -> None:
-        """Instantiate a Live Viewer instance.
+def _open_shared_memory(name: Optional[str], size: int) -> SharedMemory:
+    """Create, or attach to, a shared memory block.
+
+    Args:
+        name (Optional[str]): Name of the block to attach to, None to create one
+        size (int): Size of the block, in bytes
+
+    Returns:
+        SharedMemory: The shared memory block
+    """
+    if name is None:
+        return SharedMemory(create=True, size=size)
+
+    shm = SharedMemory(name=name)
+    # Only the creator owns the block, don't let this process' tracker destroy it
+    resource_tracker.unregister(shm._name, "shared_memory")  # type: ignore[attr-defined]
+    return shm
+
+
+class _SeqLock:
+    """Sequence counter, stored in shared memory.
+
+    The writer makes the counter odd while updating the data. A reader retries
+    until it observes the same even counter before and after its copy.
+    """
+
+    def __init__(self, header: np.ndarray) -> None:
+        self._header = header
+
+    def begin_write(self) -> None:
+        self._header[0] += 1
+
+    def end_write(self) -> None:
+        self._header[0] += 1
+
+    def read(self, copy: Callable[[], T]) -> Tuple[int, T]:
+        while True:
+            seq = int(self._header[0])
+            if seq % 2 == 0:
+                data = copy()
+                if int(self._header[0]) == seq:
+                    return seq, data
+
+
+class SharedTrace:
+    """Latest trace, shared between the capture and GUI processes."""
+
+    def __init__(self, capacity: int, name: Optional[str] = None) -> None:
+        """Create, or attach to, a shared trace slot.
 
         Args:
-            rate_limit (float, optional): Maximum refresh period, expressed in seconds. Defaults to 0.1.
+            capacity (int): Maximum number of samples of a trace
+            name (Optional[str]): Name of the shared memory to attach to. Defaults to None (create it).
         """
-        pg.mkQApp()
+        size = (2 + capacity) * 8
+        self._shm = _open_shared_memory(name, size)
+        # Header: sequence counter, trace length
+        self._header = np.ndarray((2,), dtype=np.int64, buffer=self._shm.buf)
+        self._data = np.ndarray(
+            (capacity,), dtype=np.float64, buffer=self._shm.buf, offset=16
+        )
+        if name is None:
+            self._header[:] = 0
+        self._lock = _SeqLock(self._header)
 
-        self._gui_proc = mp.QtProcess()
+    @property
+    def name(self) -> str:
+        """Get the name of the underlying shared memory."""
+        return self._shm.name
 
-        rpg = self._gui_proc._import("pyqtgraph")
-        rpg.setConfigOptions(antialias=True)
+    def write(self, samples: np.ndarray) -> None:
+        """Replace the shared trace.
 
-        self._layout = rpg.GraphicsLayoutWidget(show=True, title="Live Signal Viewer")
+        Args:
+            samples (np.ndarray): The samples
+        """
+        n = min(len(samples), len(self._data))
+        self._lock.begin_write()
+        self._data[:n] = samples[:n]
+        self._header[1] = n
+        self._lock.end_write()
+
+    def read(self) -> Tuple[int, np.ndarray]:
+        """Read the shared trace.
+
+        Returns:
+            Tuple[int, np.ndarray]: The sequence counter (changes on each write), and the trace
+        """
+        return self._lock.read(lambda: self._data[: self._header[1]].copy())
+
+    def close(self, unlink: bool = False) -> None:
+        """Detach from the shared memory.
+
+        Args:
+            unlink (bool): Also destroy the shared memory. Defaults to False.
+        """
+        del self._header, self._data
+        self._shm.close()
+        if unlink:
+            self._shm.unlink()
+
+
+class SharedHistory:
+    """Min/max decimated history of a value, shared between processes.
+
+    Values are accumulated in at most capacity bins. When all the bins are used,
+    adjacent bins are merged, and the bin width doubles. Appending a value is
+    therefore O(1) amortized, whatever the length of the run.
+    """
+
+    def __init__(self, capacity: int = 1024, name: Optional[str] = None) -> None:
+        """Create, or attach to, a shared history.
+
+        Args:
+            capacity (int): Number of bins, must be even. Defaults to 1024.
+            name (Optional[str]): Name of the shared memory to attach to. Defaults to None (create it).
+        """
+        assert capacity % 2 == 0, "The capacity must be even"
+        size = (4 + 2 * capacity) * 8
+        self._shm = _open_shared_memory(name, size)
+        # Header: sequence counter, complete bins, bin width, values in the last bin
+        self._header = np.ndarray((4,), dtype=np.int64, buffer=self._shm.buf)
+        self._mins = np.ndarray(
+            (capacity,), dtype=np.float64, buffer=self._shm.buf, offset=32
+        )
+        self._maxs = np.ndarray(
+            (capacity,),
+            dtype=np.float64,
+            buffer=self._shm.buf,
+            offset=32 + 8 * capacity,
+        )
+        if name is None:
+            self._header[:] = (0, 0, 1, 0)
+        self._capacity = capacity
+        self._lock = _SeqLock(self._header)
+
+    @property
+    def name(self) -> str:
+        """Get the name of the underlying shared memory."""
+        return self._shm.name
+
+    def append(self, value: float) -> None:
+        """Append a value to the history.
+
+        Args:
+            value (float): The value
+        """
+        _, n_bins, bin_width, count = (int(v) for v in self._header)
+
+        self._lock.begin_write()
+        if count == 0:
+            self._mins[n_bins] = value
+            self._maxs[n_bins] = value
+        else:
+            self._mins[n_bins] = min(self._mins[n_bins], value)
+            self._maxs[n_bins] = max(self._maxs[n_bins], value)
+        count += 1
+
+        if count == bin_width:
+            n_bins += 1
+            count = 0
+
+        if n_bins == self._capacity:
+            half = self._capacity // 2
+            self._mins[:half] = np.minimum(self._mins[0::2], self._mins[1::2])
+            self._maxs[:half] = np.maximum(self._maxs[0::2], self._maxs[1::2])
+            n_bins = half
+            bin_width *= 2
+
+        self._header[1:] = (n_bins, bin_width, count)
+        self._lock.end_write()
+
+    def read(self) -> Tuple[int, np.ndarray, np.ndarray]:
+        """Read the history, as a min/max envelope.
+
+        Returns:
+            Tuple[int, np.ndarray, np.ndarray]: The sequence counter, the x and y values of the envelope
+        """
+
+        def _copy() -> Tuple[np.ndarray, np.ndarray]:
+            _, n_bins, bin_width, count = (int(v) for v in self._header)
+            n = n_bins + (1 if count else 0)
+            x = np.repeat(np.arange(n) * bin_width, 2)
+            y = np.empty(2 * n)
+            y[0::2] = self._mins[:n]
+            y[1::2] = self._maxs[:n]
+            return x, y
+
+        seq, (x, y) = self._lock.read(_copy)
+        return seq, x, y
+
+    def close(self, unlink: bool = False) -> None:
+        """Detach from the shared memory.
+
+        Args:
+            unlink (bool): Also destroy the shared memory. Defaults to False.
+        """
+        del self._header, self._mins, self._maxs
+        self._shm.close()
+        if unlink:
+            self._shm.unlink()
+
+
+class _ViewerWindow:
+    """Plots, living in the GUI process and polling the shared buffers."""
+
+    def __init__(
+        self,
+        trace_name: str,
+        trace_capacity: int,
+        ranking_name: str,
+        temperature_name: str,
+        history_capacity: int,
+        rate_limit: float,
+    ) -> None:
+        pg.setConfigOptions(antialias=True)
+
+        self._trace = SharedTrace(trace_capacity, trace_name)
+        self._ranks = SharedHistory(history_capacity, ranking_name)
+        self._temperatures = SharedHistory(history_capacity, temperature_name)
+        self._seqs = [-1, -1, -1]
+
+        self._layout = pg.GraphicsLayoutWidget(show=True, title="Live Signal Viewer")
 
         trace_plot = self._layout.addPlot(
             title="Current Trace", row=1, col=0, colspan=2
@@ -38,13 +249,75 @@ class LiveSignalViewer:
         ranking_plot = self._layout.addPlot(title="Average Ranking", row=2, col=0)
         self._ranking_curve = ranking_plot.plot(pen="y")
         ranking_plot.showGrid(x=True, y=True)
-        self._ranks: list[float] = []
 
         temperature_plot = self._layout.addPlot(title="DUT Temperature", row=2, col=1)
         self._temperature_curve = temperature_plot.plot(pen="y")
         temperature_plot.showGrid(x=True, y=True)
-        temperature_plot.setXRange(0, 500, padding=0.2)
-        self._temperatures: list[float] = []
+
+        self._timer = pg.QtCore.QTimer()
+        self._timer.timeout.connect(self._refresh)
+        self._timer.start(int(rate_limit * 1000))
+
+    def _refresh(self) -> None:
+        seq, samples = self._trace.read()
+        if seq != self._seqs[0]:
+            self._trace_curve.setData(y=samples)
+            self._seqs[0] = seq
+
+        for n, history, curve in (
+            (1, self._ranks, self._ranking_curve),
+            (2, self._temperatures, self._temperature_curve),
+        ):
+            seq, x, y = history.read()
+            if seq != self._seqs[n]:
+                curve.setData(x=x, y=y)
+                self._seqs[n] = seq
+
+    def close(self) -> None:
+        self._timer.stop()
+        self._trace.close()
+        self._ranks.close()
+        self._temperatures.close()
+
+
+class LiveSignalViewer:
+    """GUI live viewer of the captured signals.
+
+    Data is exchanged with the GUI process through shared memory, which the GUI
+    polls. Updates never wait for the GUI, and cost O(1) regardless of the length of
+    the run: rankings and temperatures are kept as min/max decimated histories.
+    """
+
+    def __init__(
+        self,
+        rate_limit=0.1,
+        trace_capacity: int = 1 << 16,
+        history_capacity: int = 1024,
+    ) -> None:
+        """Instantiate a Live Viewer instance.
+
+        Args:
+            rate_limit (float, optional): Maximum refresh period, expressed in seconds. Defaults to 0.1.
+            trace_capacity (int, optional): Maximum number of samples of a trace. Defaults to 65536.
+            history_capacity (int, optional): Number of points of the histories. Defaults to 1024.
+        """
+        self._trace = SharedTrace(trace_capacity)
+        self._ranks = SharedHistory(history_capacity)
+        self._temperatures = SharedHistory(history_capacity)
+
+        pg.mkQApp()
+
+        self._gui_proc = mp.QtProcess()
+
+        remote = self._gui_proc._import("esp_cpa_board.live_signal_viewer")
+        self._window = remote._ViewerWindow(
+            self._trace.name,
+            trace_capacity,
+            self._ranks.name,
+            self._temperatures.name,
+            history_capacity,
+            rate_limit,
+        )
 
         self._last_update = time.time()
         self._rate_limit = rate_limit
@@ -56,8 +329,6 @@ class LiveSignalViewer:
             rank (float): The ranking point to add
         """
         self._ranks.append(rank)
-        t_data = self._gui_proc.transfer(self._ranks)
-        self._ranking_curve.setData(y=t_data, _callSync="off")
 
     def add_temperature(self, temperature: float) -> None:
         """Add a temperature point to the graph.
@@ -65,11 +336,7 @@ class LiveSignalViewer:
         Args:
             temperature (float): The temperature point to add
         """
-        if len(self._temperatures) > 500:
-            self._temperatures = []
         self._temperatures.append(temperature)
-        t_data = self._gui_proc.transfer(self._temperatures)
-        self._temperature_curve.setData(y=t_data, _callSync="off")
 
     def feed(self, samples: np.ndarray) -> None:
         """Feed samples.
@@ -79,6 +346,15 @@ class LiveSignalViewer:
         """
         t = time.time()
         if t - self._last_update > self._rate_limit:
-            t_data = self._gui_proc.transfer(samples)
-            self._trace_curve.setData(y=t_data, _callSync="off")
+            self._trace.write(samples)
             self._last_update = t
+
+    def close(self) -> None:
+        """Stop the GUI process, and release the shared buffers."""
+        try:
+            self._window.close(_callSync="off")
+            self._gui_proc.close()
+        finally:
+            self._trace.close(unlink=True)
+            self._ranks.close(unlink=True)
+            self._temperatures.close(unlink=True)
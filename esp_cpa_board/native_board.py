@@ -0,0 +1,123 @@
+#!/usr/bin/env python3
+"""EspCpaBoard driven by the native capture engine of cpa_lib."""
+
+from typing import Any, Dict, Optional, Tuple
+
+import numpy as np
+
+__all__ = ["NativeEspCpaBoard"]
+
+
+class NativeEspCpaBoard:
+    """Drop-in replacement of EspCpaBoard, for capture campaigns.
+
+    Commands, transfers, sample decoding and payload generation are all done by
+    the Rust library: a whole chunk of measurements is captured without returning
+    to Python. The board must have been configured beforehand (see ctrl.py).
+    """
+
+    def __init__(self, config: Dict[str, Any], device: Optional[str] = None) -> None:
+        """Initialize the class.
+
+        Args:
+            config: A dictionary containing configuration parameters.
+            device (Optional[str]): Bus path (e.g. "1-2.3") or serial number of the board. Defaults to None (first board found).
+        """
+        self._config = config
+        self._device = device
+        self._board: Any = None
+
+    @property
+    def device(self) -> Optional[str]:
+        """Get the identifier of the board, as given to the constructor."""
+        return self._device
+
+    def connect(self) -> None:
+        """Connect to the board control interface."""
+        # Imported here, so that the other capture tools don't depend on the Rust library
+        import cpa_lib
+
+        self._board = cpa_lib.NativeBoard(self._device)
+
+    def set_dut_power(self, power: bool) -> None:
+        """Set the DUT_POWER line level.
+
+        Args:
+            power (bool): The level
+        """
+        self._board.set_dut_power(power)
+
+    def set_clk_en(self, en: bool) -> None:
+        """Set the DUT_CLK_EN line level.
+
+        Args:
+            en (bool): The level
+        """
+        self._board.set_clk_en(en)
+
+    def set_amplifier_gain(self, gain: int) -> None:
+        """Set the gain of the amplifier.
+
+        Args:
+            gain (int): The gain, expressed in percents.
+        """
+        self._board.set_amplifier_gain(gain)
+
+    def set_flash_payload(self, payload: bytes) -> None:
+        """Set the fake flash payload.
+
+        Args:
+            payload (bytes): The flash payload
+        """
+        self._board.set_flash_payload(payload)
+
+    def perform_measurement(
+        self, n_samples: int = 0x8000, n_measurements: int = 1
+    ) -> np.ndarray:
+        """Perform a power trace measurement.
+
+        Args:
+            n_samples (int): Number of samples to be measured for each measurement. Default is 0x8000.
+            n_measurements (int): Number of consecutive measurements to be performed. Default is 1.
+
+        Returns:
+            np.ndarray: Array containing the measurement results.
+        """
+        return self._board.perform_measurement(n_samples, n_measurements)
+
+    def capture_chunk(self, chunk_size: int) -> Tuple[np.ndarray, np.ndarray]:
+        """Capture measurements of random payloads.
+
+        Args:
+            chunk_size (int): Number of measurements
+
+        Returns:
+            Tuple[np.ndarray, np.ndarray]: The payloads (chunk_size, 16), and the samples (chunk_size, averaging, n_samples)
+        """
+        return self._board.capture_chunk(
+            chunk_size, self._config["averaging"], self._config["n_samples"]
+        )
+
+    def stats(self) -> Dict[str, float]:
+        """Get the cumulative capture counters.
+
+        Returns:
+            Dict[str, float]: Number of measurements, and capture time in seconds
+        """
+        return self._board.stats()
+
+    def get_temperature(self) -> float:
+        """Get the DUT temperature read by the cartridge sensor.
+
+        Returns:
+            float: The temperature, expressed in °C
+        """
+        return self._board.get_temperature()
+
+    def set_heater_pwm(self, value: int) -> None:
+        """Set the cartridge heater PWM value.
+
+        Args:
+            value (int): The PWM value
+        """
+        self._board.set_heater_pwm(value)
@@ -0,0 +1,57 @@
+#!/usr/bin/env python3
+"""Compression codec of the 12-bit ADC samples."""
+
+from typing import Any, Optional
+
+import numpy as np
+from numcodecs.abc import Codec
+from numcodecs.compat import ensure_bytes, ensure_contiguous_ndarray, ndarray_copy
+from numcodecs.registry import register_codec
+
+__all__ = ["SampleCodec"]
+
+
+class SampleCodec(Codec):
+    """Lossless codec of 12-bit samples, stored as i2.
+
+    Each sample is predicted from the previous one. The residuals, taken modulo
+    2^12, are zigzag encoded and bitpacked by blocks of 128, each block with the
+    smallest width holding its residuals. Encoding and decoding are done by
+    cpa_lib, and chunks not made of 12-bit values are stored as is.
+    """
+
+    codec_id = "esp_cpa_board.sample_codec"
+
+    def encode(self, buf: Any) -> bytes:
+        """Encode a chunk of samples.
+
+        Args:
+            buf (Any): The samples, of type i2
+
+        Returns:
+            bytes: The encoded chunk
+        """
+        # Imported here, so that reading datasets doesn't need cpa_lib unless
+        # this codec was used
+        import cpa_lib
+
+        samples = ensure_contiguous_ndarray(buf).view("<i2")
+        return cpa_lib.encode_samples(samples)
+
+    def decode(self, buf: Any, out: Optional[Any] = None) -> Any:
+        """Decode a chunk of samples.
+
+        Args:
+            buf (Any): The encoded chunk
+            out (Optional[Any]): Buffer to decode into. Defaults to None.
+
+        Returns:
+            Any: The samples
+        """
+        import cpa_lib
+
+        samples: np.ndarray = cpa_lib.decode_samples(ensure_bytes(buf))
+        return ndarray_copy(samples, out)
+
+
+register_codec(SampleCodec)
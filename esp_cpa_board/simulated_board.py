@@ -0,0 +1,238 @@
+#!/usr/bin/env python3
+"""Simulated EspCpaBoard, to exercise the capture tools without hardware."""
+
+import time
+from threading import RLock
+from typing import Any, Dict, List, Optional, Tuple
+
+import numpy as np
+
+from .aes_lut import GAL9, GAL11, GAL13, GAL14, INV_SBOX, SBOX
+
+__all__ = ["SimulatedEspCpaBoard", "leakage_table", "leakage_signal"]
+
+
+def leakage_table(model: str) -> np.ndarray:
+    """Get the Hamming weight leaked by each value of (plaintext ^ key).
+
+    Args:
+        model (str): round0 (forward sbox) or round0dectable (inverse sbox, then decryption table lookup)
+
+    Returns:
+        np.ndarray: The leaked Hamming weights
+    """
+    if model == "round0":
+        values = [SBOX[x] for x in range(256)]
+    elif model == "round0dectable":
+        values = []
+        for x in range(256):
+            i = INV_SBOX[x]
+            values.append(GAL9[i] | GAL11[i] << 8 | GAL13[i] << 16 | GAL14[i] << 24)
+    else:
+        raise ValueError(f"Unknown model {model}")
+    return np.array([bin(v).count("1") for v in values], dtype=np.float32)
+
+
+def leakage_signal(
+    plaintext: np.ndarray,
+    round_key: bytes,
+    n_samples: int,
+    leakage: np.ndarray,
+    offset: int,
+    spacing: int,
+    amplitude: float,
+) -> np.ndarray:
+    """Get the noiseless leakage of a set of plaintexts.
+
+    The round 0 key byte j leaks at sample offset + j * spacing, as a short burst
+    modulated by the Hamming weight of the targeted intermediate value.
+
+    Args:
+        plaintext (np.ndarray): The plaintexts, one per row (not reversed)
+        round_key (bytes): The round 0 key
+        n_samples (int): Number of samples of a trace
+        leakage (np.ndarray): The leakage table, see `leakage_table`
+        offset (int): Sample of the first leakage
+        spacing (int): Number of samples between consecutive key bytes
+        amplitude (float): Amplitude of the bursts, per unit of Hamming weight
+
+    Returns:
+        np.ndarray: The leakage, one trace per plaintext
+    """
+    # Hann-windowed burst, in the band of the analysis filters
+    burst = amplitude * np.hanning(20) * np.sin(np.arange(20) * np.pi / 10)
+
+    signal = np.zeros((plaintext.shape[0], n_samples), dtype=np.float32)
+    for j in range(16):
+        hw = leakage[plaintext[:, j] ^ round_key[j]]
+        start = offset + j * spacing
+        signal[:, start : start + len(burst)] += (hw - np.mean(leakage))[
+            :, None
+        ] * burst[None]
+    return signal
+
+
+class SimulatedEspCpaBoard:
+    """Drop-in replacement of EspCpaBoard, producing synthetic traces.
+
+    Traces have the same leakage as the ones of `utils.py generate-capture`, with a
+    board specific gain and offset. The measurement time of the real board can be
+    emulated, so that capture throughput can be studied without hardware.
+    """
+
+    def __init__(
+        self,
+        config: Dict[str, Any],
+        round_key: bytes,
+        device: Optional[str] = None,
+        model: str = "round0dectable",
+        leakage_offset: int = 300,
+        leakage_spacing: int = 24,
+        leakage_amplitude: float = 8.0,
+        noise: float = 20.0,
+        measurement_time: float = 0.0,
+        seed: Optional[int] = None,
+    ) -> None:
+        """Initialize the class.
+
+        Args:
+            config: A dictionary containing configuration parameters.
+            round_key (bytes): The round 0 key leaked by the traces
+            device (Optional[str]): Identifier of the board. Defaults to None.
+            model (str): Leakage model, see `leakage_table`. Defaults to "round0dectable".
+            leakage_offset (int): Sample of the first leakage. Defaults to 300.
+            leakage_spacing (int): Number of samples between consecutive key bytes. Defaults to 24.
+            leakage_amplitude (float): Amplitude of the leakage bursts. Defaults to 8.0.
+            noise (float): Standard deviation of the noise. Defaults to 20.0.
+            measurement_time (float): Emulated duration of a measurement, expressed in seconds. Defaults to 0.0.
+            seed (Optional[int]): Seed of the random generator. Defaults to None.
+        """
+        self._config = config
+        self._round_key = round_key
+        self._device = device
+        self._leakage = leakage_table(model)
+        self._leakage_offset = leakage_offset
+        self._leakage_spacing = leakage_spacing
+        self._leakage_amplitude = leakage_amplitude
+        self._noise = noise
+        self._measurement_time = measurement_time
+
+        self._rng = np.random.default_rng(seed)
+        self._mutex = RLock()
+        self._payload = bytes(16)
+        self._temperature = 35.0
+
+        # Boards differ slightly
+        self._gain = 1.0 + self._rng.normal(0.0, 0.05)
+        self._offset = self._rng.normal(0.0, 5.0)
+
+    @staticmethod
+    def list_devices(n_boards: int = 1) -> List[Tuple[str, Optional[str]]]:
+        """List simulated boards.
+
+        Args:
+            n_boards (int): Number of boards. Defaults to 1.
+
+        Returns:
+            List[Tuple[str, Optional[str]]]: The bus path and serial number of each board
+        """
+        return [(f"sim-{n}", None) for n in range(n_boards)]
+
+    @property
+    def device(self) -> Optional[str]:
+        """Get the identifier of the board, as given to the constructor."""
+        return self._device
+
+    def configure(self) -> None:
+        """Configure a board (firmware + gateware)."""
+        pass
+
+    def connect(self) -> None:
+        """Connect to the board control interface."""
+        pass
+
+    def set_dut_power(self, power: bool) -> None:
+        """Set the DUT_POWER line level.
+
+        Args:
+            power (bool): The level
+        """
+        pass
+
+    def set_clk_en(self, en: bool) -> None:
+        """Set the DUT_CLK_EN line level.
+
+        Args:
+            en (bool): The level
+        """
+        pass
+
+    def set_amplifier_gain(self, gain: int) -> None:
+        """Set the gain of the amplifier.
+
+        Args:
+            gain (int): The gain, expressed in percents.
+        """
+        pass
+
+    def set_flash_payload(self, payload: bytes) -> None:
+        """Set the fake flash payload.
+
+        Args:
+            payload (bytes): The flash payload
+        """
+        with self._mutex:
+            self._payload = payload
+
+    def perform_measurement(
+        self, n_samples: int = 0x8000, n_measurements: int = 1
+    ) -> np.ndarray:
+        """Perform a power trace measurement.
+
+        Args:
+            n_samples (int): Number of samples to be measured for each measurement. Default is 0x8000.
+            n_measurements (int): Number of consecutive measurements to be performed. Default is 1.
+
+        Returns:
+            np.ndarray: Array containing the measurement results.
+        """
+        if self._measurement_time:
+            time.sleep(self._measurement_time)
+
+        with self._mutex:
+            # Payloads are stored in reverse order (ESP32 implementation detail)
+            plaintext = np.frombuffer(self._payload, dtype=np.uint8)[None, ::-1]
+            signal = leakage_signal(
+                plaintext,
+                self._round_key,
+                n_samples,
+                self._leakage,
+                self._leakage_offset,
+                self._leakage_spacing,
+                self._leakage_amplitude,
+            )
+            samples = self._rng.standard_normal(
+                size=(n_measurements, n_samples), dtype=np.float32
+            )
+            samples = self._gain * (samples * self._noise + signal) + self._offset
+
+            # 12-bit signed ADC
+            return np.clip(np.round(samples), -2048, 2047).astype(int)
+
+    def get_temperature(self) -> float:
+        """Get the DUT temperature read by the cartridge sensor.
+
+        Returns:
+            float: The temperature, expressed in °C
+        """
+        with self._mutex:
+            self._temperature += self._rng.normal(0.0, 0.01)
+            return self._temperature
+
+    def set_heater_pwm(self, value: int) -> None:
+        """Set the cartridge heater PWM value.
+
+        Args:
+            value (int): The PWM value
+        """
+        pass
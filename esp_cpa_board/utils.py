@@ -3,11 +3,13 @@
 
 
 from pathlib import Path
-from typing import Any, Dict
+from typing import Any, Dict, List, Optional, Tuple
 
 import numpy as np
 from scipy import signal
 
+from .drift import DriftCompensator
+
 
 def load_config(filename: Path) -> Dict[str, Any]:
     """Load configuration variables.
@@ -23,6 +25,88 @@ def load_config(filename: Path) -> Dict[str, Any]:
     return config
 
 
+def poi_windows(config: Dict[str, Any]) -> Optional[List[int]]:
+    """Get the number of POIs of each key byte.
+
+    `poi` is either a list of sample indexes shared by all the key bytes, or a
+    mapping from each key byte to its own list.
+
+    Args:
+        config (Dict[str, Any]): The analysis configuration
+
+    Returns:
+        Optional[List[int]]: The number of POIs of each byte, None if they are shared
+    """
+    poi = config["poi"]
+    if not isinstance(poi, dict):
+        return None
+
+    if sorted(poi) != list(range(16)):
+        raise ValueError("Per-byte POIs must be given for the 16 key bytes")
+    windows = [len(poi[j]) for j in range(16)]
+    if min(windows) == 0:
+        raise ValueError("Per-byte POIs must not be empty")
+    return windows
+
+
+def poi_slices(config: Dict[str, Any]) -> List[slice]:
+    """Get the columns of each key byte in the samples selected by `poi_indexes`.
+
+    Args:
+        config (Dict[str, Any]): The analysis configuration
+
+    Returns:
+        List[slice]: The columns of each of the 16 key bytes, all of them if POIs
+            are shared
+    """
+    windows = poi_windows(config)
+    if windows is None:
+        return [slice(None)] * 16
+
+    offsets = np.cumsum([0] + windows).tolist()
+    return [slice(a, b) for a, b in zip(offsets, offsets[1:])]
+
+
+def poi_indexes(config: Dict[str, Any]) -> List[int]:
+    """Get the sample indexes selected by the POI configuration.
+
+    Per-byte POIs are packed byte after byte, see `poi_windows`.
+
+    Args:
+        config (Dict[str, Any]): The analysis configuration
+
+    Returns:
+        List[int]: The sample indexes
+    """
+    poi = config["poi"]
+    if poi_windows(config) is None:
+        return list(poi)
+    return [t for j in range(16) for t in poi[j]]
+
+
+def required_samples(config: Dict[str, Any]) -> int:
+    """Get the number of leading samples of each trace an analysis needs.
+
+    Enough samples are kept after the last POI to stay clear of filter edge
+    effects, and the whole alignment search window is covered.
+
+    Args:
+        config (Dict[str, Any]): The analysis configuration
+
+    Returns:
+        int: The number of samples
+    """
+    n_samples = max(poi_indexes(config)) + 256
+
+    alignment = config.get("alignment")
+    if alignment is not None:
+        n_samples = max(
+            n_samples,
+            alignment["offset"] + alignment["length"] + alignment["max_shift"],
+        )
+    return n_samples
+
+
 class SignalPreprocessor:
     """Traces pre-processor."""
 
@@ -38,26 +122,139 @@ class SignalPreprocessor:
             )
 
         self._config = config
+        self._aligner: Any = None
+        self._drift_compensator: Optional[DriftCompensator] = None
 
-    def process(self, samples: np.ndarray) -> np.ndarray:
-        """Pre-process a captured trace.
+    @property
+    def filter_key(self) -> Tuple[Any, ...]:
+        """Get a key identifying the filtering stage of this pre-processor.
+
+        Pre-processors sharing the same key produce the same filtered traces,
+        and can share the output of `filter`.
+
+        Returns:
+            Tuple[Any, ...]: The filter parameters
+        """
+        key: Tuple[Any, ...] = (None,)
+        if self._config["f_type"] is not None:
+            key = (
+                self._config["f_type"],
+                self._config["f_order"],
+                # butter() takes a scalar cutoff as well as a sequence
+                tuple(np.atleast_1d(self._config["f_cutoff"]).tolist()),
+            )
+        if self._config.get("alignment") is not None:
+            key += (tuple(sorted(self._config["alignment"].items())),)
+        return key
+
+    def filter(self, samples: np.ndarray) -> np.ndarray:
+        """Average and filter a captured trace.
 
         Args:
             samples (np.ndarray): The captured samples
 
         Returns:
-            np.ndarray: The processed samples
+            np.ndarray: The filtered samples
         """
         samples = np.mean(samples, axis=1)
 
         if self._config["f_type"] is not None:
             samples = signal.filtfilt(self._f_b, self._f_a, samples, axis=1)
 
+        if self._config.get("alignment") is not None:
+            samples = self.align(samples)
+
+        return samples
+
+    def align(self, samples: np.ndarray) -> np.ndarray:
+        """Align traces on the reference pattern of the alignment configuration.
+
+        The alignment configuration is a dictionary with the offset and length of the
+        pattern, the max_shift to search for, and an optional elastic_radius (0 disables
+        elastic alignment). Unless a reference file (.npy) is given, the reference is
+        the average pattern of the first traces to be aligned.
+
+        Args:
+            samples (np.ndarray): The samples, one trace per row
+
+        Returns:
+            np.ndarray: The aligned samples
+        """
+        # Imported here, so that capture tools don't depend on the Rust library
+        import cpa_lib
+
+        samples = np.ascontiguousarray(samples, dtype=np.float64)
+
+        if self._aligner is None:
+            config = self._config["alignment"]
+            offset = config["offset"]
+            window = slice(offset, offset + config["length"])
+
+            def _build_aligner(reference: np.ndarray) -> Any:
+                return cpa_lib.TraceAligner(
+                    np.ascontiguousarray(reference, dtype=np.float64),
+                    offset,
+                    config["max_shift"],
+                    config.get("elastic_radius", 0),
+                )
+
+            if config.get("reference") is not None:
+                reference = np.load(config["reference"])
+            else:
+                # Refine the averaged pattern once, with traces aligned on it
+                reference = np.mean(samples[:, window], axis=0)
+                aligned, _ = _build_aligner(reference).align(samples)
+                reference = np.mean(aligned[:, window], axis=0)
+
+            self._aligner = _build_aligner(reference)
+
+        aligned, _ = self._aligner.align(samples)
+        return aligned
+
+    def select(
+        self, samples: np.ndarray, temperatures: Optional[np.ndarray] = None
+    ) -> np.ndarray:
+        """Select the POIs of a filtered trace and apply drift compensation.
+
+        Per-byte POIs are packed byte after byte, see `poi_indexes`.
+
+        With drift_compensation = "temperature", the drift is compensated across
+        chunks, see `DriftCompensator`. The time constant of its running baseline is
+        given by the optional drift_window configuration value (in traces).
+
+        Args:
+            samples (np.ndarray): The filtered samples, as returned by `filter`
+            temperatures (Optional[np.ndarray]): The temperature of each trace, see
+                `interpolate_temperatures`. Defaults to None.
+
+        Returns:
+            np.ndarray: The processed samples
+        """
         # POI selection
-        samples = samples[:, self._config["poi"]]
+        samples = samples[:, poi_indexes(self._config)]
 
-        if self._config["drift_compensation"]:
+        if self._config["drift_compensation"] == "temperature":
+            if self._drift_compensator is None:
+                self._drift_compensator = DriftCompensator(
+                    self._config.get("drift_window", 1000)
+                )
+            samples = self._drift_compensator.process(samples, temperatures)
+        elif self._config["drift_compensation"]:
             samples -= np.mean(samples, axis=0, keepdims=True)
             samples /= np.var(samples, axis=0, keepdims=True)
 
         return samples
+
+    def process(
+        self, samples: np.ndarray, temperatures: Optional[np.ndarray] = None
+    ) -> np.ndarray:
+        """Pre-process a captured trace.
+
+        Args:
+            samples (np.ndarray): The captured samples
+            temperatures (Optional[np.ndarray]): The temperature of each trace. Defaults to None.
+
+        Returns:
+            np.ndarray: The processed samples
+        """
+        return self.select(self.filter(samples), temperatures)
@@ -1,15 +1,23 @@
 #!/usr/bin/env python3
 """Various AES-related tools."""
 
+import os
 import struct
 from binascii import unhexlify
+from collections import deque
+from concurrent.futures import Future, ProcessPoolExecutor
+from functools import lru_cache
+from itertools import islice
 from pathlib import Path
-from typing import List, Tuple
+from typing import Annotated, Any, Deque, Iterator, List, Optional, Tuple
 
+import numpy as np
 import typer
+import zarr
 from aeskeyschedule import key_schedule, reverse_key_schedule
 from Crypto.Cipher import AES
 from rich import print
+from rich.progress import Progress
 from rich.table import Table
 
 from esp_cpa_board.aes_utils import (
@@ -19,10 +27,30 @@ from esp_cpa_board.aes_utils import (
     mix_columns_inv,
     xor,
 )
+from esp_cpa_board.key_rank import correlation_log_likelihoods, enumerate_keys
 
 app = typer.Typer()
 
 
+@lru_cache(maxsize=16)
+def _xts_encryption_key(mk1: bytes) -> Tuple[bytes, bytes]:
+    """Recover the encryption key from the modified key of the second decryption round.
+
+    Args:
+        mk1 (bytes): The modified key of the second decryption round
+
+    Returns:
+        Tuple[bytes, bytes]: The encryption key and the first decryption round key
+    """
+    k1 = mix_columns(mk1)  # Second decryption round key
+
+    key_e = reverse_key_schedule(k1, 9)  # Recover decryption key
+
+    k0 = key_schedule(key_e)[-1]  # Compute first decyption round key
+
+    return (key_e, k0)
+
+
 def _xts_key_recovery(
     tk0: bytes,
     mk1: bytes,
@@ -36,11 +64,7 @@ def _xts_key_recovery(
     weturns:
         Tuple[bytes, List[bytes]]: The encryption key and tweaks
     """
-    k1 = mix_columns(mk1)  # Second decryption round key
-
-    key_e = reverse_key_schedule(k1, 9)  # Recover decryption key
-
-    k0 = key_schedule(key_e)[-1]  # Compute first decyption round key
+    key_e, k0 = _xts_encryption_key(mk1)
 
     t6 = xor(k0, tk0)  # Recover tweak at tweak index 6
 
@@ -54,6 +78,63 @@ def _xts_key_recovery(
     return (key_e, tn)
 
 
+def _xts_process_block(
+    cipher_e: Any, block: bytes, tweak: bytes, do_decrypt: bool
+) -> bytes:
+    """Decrypt/Encrypt a single 16-byte block of AES-XTS data.
+
+    Args:
+        cipher_e (Any): The AES-ECB cipher built from the encryption key
+        block (bytes): The block to process
+        tweak (bytes): The tweak of this block
+        do_decrypt (bool): Set to True to perform decryption, False for encryption
+
+    Returns:
+        bytes: The processed block
+    """
+    block = xor(block, tweak)
+
+    if do_decrypt:
+        block = cipher_e.decrypt(block)
+    else:
+        block = cipher_e.encrypt(block)
+
+    return xor(block, tweak)
+
+
+def _xts_process_data(
+    input_data: bytes,
+    tk0: bytes,
+    mk1: bytes,
+    do_decrypt: bool,
+) -> bytes:
+    """Decrypt/Encrypt the first (flash offset = 0) 128 bits of AEX-XTS encrypted data.
+
+    Args:
+        input_data (bytes): Input data
+        tk0 (bytes): The tweaked key of the first decryption round
+        mk1 (bytes): The modified key of the second decryption round
+        do_decrypt (bool): Set to True to perform decryption, False for encryption
+
+    Returns:
+        bytes: The processed data
+    """
+    key_e, tn = _xts_key_recovery(tk0, mk1)
+
+    cipher_e = AES.new(key_e, AES.MODE_ECB)
+
+    assert len(input_data) == 0x80, "Invalid data size"
+
+    input_data = input_data[::-1]
+
+    output_data = b""
+    for i in range(8):
+        block = input_data[i * 16 : (i + 1) * 16]
+        output_data += _xts_process_block(cipher_e, block, tn[i], do_decrypt)
+
+    return output_data[::-1]
+
+
 def _xts_encrypt_decrypt(
     data_input_filename: Path,
     tk0: bytes,
@@ -70,33 +151,127 @@ def _xts_encrypt_decrypt(
         data_output_filename (Path): Output data file
         do_decrypt (bool): Set to True to perform decryption, False for encryption
     """
-    key_e, tn = _xts_key_recovery(tk0, mk1)
+    input_data = open(data_input_filename, "rb").read()
 
-    cipher_e = AES.new(key_e, AES.MODE_ECB)
+    output_data = _xts_process_data(input_data, tk0, mk1, do_decrypt)
+
+    with open(data_output_filename, "wb") as f:
+        f.write(output_data)
 
-    encrypted_data = open(data_input_filename, "rb").read()
-    assert len(encrypted_data) == 0x80, "Invalid data size"
 
-    encrypted_data = encrypted_data[::-1]
+def _xts_check_candidates(
+    candidates: List[Tuple[bytes, bytes]],
+    encrypted_data: bytes,
+    decrypted_data: bytes,
+) -> Optional[int]:
+    """Check (tk0, mk1) key candidates against known encrypted and decrypted data.
 
-    decrypted_data = b""
-    for i in range(8):
-        block = encrypted_data[i * 16 : (i + 1) * 16]
-        block = xor(block, tn[i])
+    Only the block using tweak index 6 is checked, since its tweak is directly
+    derived from tk0.
 
-        if do_decrypt:
-            block = cipher_e.decrypt(block)
-        else:
-            block = cipher_e.encrypt(block)
+    Args:
+        candidates (List[Tuple[bytes, bytes]]): The (tk0, mk1) candidates
+        encrypted_data (bytes): The encrypted data
+        decrypted_data (bytes): The expected decrypted data
 
-        block = xor(block, tn[i])
+    Returns:
+        Optional[int]: The index of the first valid candidate, None if no candidate is valid
+    """
+    encrypted_block = encrypted_data[::-1][6 * 16 : 7 * 16]
+    decrypted_block = decrypted_data[::-1][6 * 16 : 7 * 16]
 
-        decrypted_data += block
+    for n, (tk0, mk1) in enumerate(candidates):
+        key_e, k0 = _xts_encryption_key(mk1)
+        t6 = xor(k0, tk0)
+        cipher_e = AES.new(key_e, AES.MODE_ECB)
+        if _xts_process_block(cipher_e, encrypted_block, t6, True) == decrypted_block:
+            return n
 
-    decrypted_data = decrypted_data[::-1]
+    return None
 
-    with open(data_output_filename, "wb") as f:
-        f.write(decrypted_data)
+
+def _load_log_likelihoods(corr_filename: Path) -> np.ndarray:
+    """Load the per-byte log-likelihoods of the last step of a correlation file.
+
+    Args:
+        corr_filename (Path): The correlation file
+
+    Returns:
+        np.ndarray: The log-likelihoods, shaped (16, 256)
+    """
+    corr = zarr.open(corr_filename, "r")
+    # LRA and MIA scores are not correlation coefficients
+    solver = corr.attrs.get("solver", "cpa")
+    if solver != "cpa":
+        raise typer.BadParameter(
+            f"{corr_filename} holds {solver} scores, not correlation coefficients"
+        )
+    return correlation_log_likelihoods(
+        np.array(corr[:, -1]), corr.shape[1] * corr.attrs.get("chunk_size", 5000)
+    )
+
+
+def _xts_candidates(
+    tk0: Optional[str],
+    tk0_corr_filename: Optional[Path],
+    mk1: Optional[str],
+    mk1_corr_filename: Optional[Path],
+    max_candidates: int,
+) -> Iterator[Tuple[bytes, bytes]]:
+    """Build a generator of (tk0, mk1) candidates, in decreasing likelihood order.
+
+    Each key is either known, or enumerated from correlation results.
+
+    Args:
+        tk0 (Optional[str]): The tweaked key of the first decryption round, if known
+        tk0_corr_filename (Optional[Path]): Correlation results of the first decryption round
+        mk1 (Optional[str]): The modified key of the second decryption round, if known
+        mk1_corr_filename (Optional[Path]): Correlation results of the second decryption round
+        max_candidates (int): Maximum number of candidates to generate
+
+    Returns:
+        Iterator[Tuple[bytes, bytes]]: The (tk0, mk1) candidates
+    """
+    known: List[Optional[bytes]] = []
+    log_likelihoods = []
+    for name, value, corr_filename in (
+        ("tk0", tk0, tk0_corr_filename),
+        ("mk1", mk1, mk1_corr_filename),
+    ):
+        if (value is None) == (corr_filename is None):
+            raise typer.BadParameter(
+                f"Either {name} or its correlation file must be provided"
+            )
+        if value is not None:
+            raw_value = unhexlify(value)
+            if len(raw_value) != 16:
+                raise typer.BadParameter(
+                    f"The size of {name} is expected to be 16 bytes"
+                )
+            known.append(raw_value)
+        else:
+            assert corr_filename is not None
+            known.append(None)
+            log_likelihoods.append(_load_log_likelihoods(corr_filename))
+
+    if not log_likelihoods:
+        raise typer.BadParameter("At least one correlation file must be provided")
+
+    def _generate() -> Iterator[Tuple[bytes, bytes]]:
+        for candidate in enumerate_keys(
+            np.concatenate(log_likelihoods), max_candidates
+        ):
+            keys = []
+            offset = 0
+            for k in known:
+                if k is None:
+                    keys.append(candidate[offset : offset + 16])
+                    offset += 16
+                else:
+                    keys.append(k)
+            yield (keys[0], keys[1])
+
+    return _generate()
 
 
 @app.command()
@@ -131,6 +306,101 @@ def xts_encrypt(
     )
 
 
+@app.command()
+def xts_enumerate_keys(
+    data_input_filename: Path,
+    data_decrypted_filename: Path,
+    tk0: Annotated[
+        Optional[str],
+        typer.Option(help="The tweaked key of the first decryption round, if known"),
+    ] = None,
+    tk0_corr_filename: Annotated[
+        Optional[Path],
+        typer.Option(help="Correlation results of the first decryption round"),
+    ] = None,
+    mk1: Annotated[
+        Optional[str],
+        typer.Option(help="The modified key of the second decryption round, if known"),
+    ] = None,
+    mk1_corr_filename: Annotated[
+        Optional[Path],
+        typer.Option(help="Correlation results of the second decryption round"),
+    ] = None,
+    max_candidates: int = 2**20,
+    batch_size: int = 4096,
+    n_workers: Optional[int] = None,
+):
+    """Enumerate AES-XTS key candidates in likelihood order, using known decrypted data."""
+    encrypted_data = data_input_filename.read_bytes()
+    decrypted_data = data_decrypted_filename.read_bytes()
+
+    if len(encrypted_data) != 0x80 or len(decrypted_data) != 0x80:
+        raise typer.BadParameter("Data files are expected to be 0x80 bytes long")
+
+    candidates = _xts_candidates(
+        tk0, tk0_corr_filename, mk1, mk1_corr_filename, max_candidates
+    )
+
+    n_workers = n_workers or os.cpu_count() or 1
+
+    found: Optional[Tuple[int, Tuple[bytes, bytes]]] = None
+    n_tested = 0
+
+    with ProcessPoolExecutor(max_workers=n_workers) as executor, Progress() as progress:
+        task = progress.add_task("Enumerating...", total=max_candidates)
+
+        # Keep a bounded number of batches in flight, and check them in order
+        pending: Deque[Tuple[int, List[Tuple[bytes, bytes]], Future]] = deque()
+        while True:
+            batch = list(islice(candidates, batch_size))
+            if batch:
+                future = executor.submit(
+                    _xts_check_candidates, batch, encrypted_data, decrypted_data
+                )
+                pending.append((n_tested, batch, future))
+                n_tested += len(batch)
+
+            if not pending:
+                break
+
+            if batch and len(pending) < 2 * n_workers:
+                continue
+
+            offset, checked_batch, future = pending.popleft()
+            progress.update(task, completed=offset + len(checked_batch))
+
+            n = future.result()
+            if n is not None:
+                found = (offset + n, checked_batch[n])
+                for _, _, future in pending:
+                    future.cancel()
+                break
+
+    if found is None:
+        print(f"Key not found in the {n_tested} most likely candidates")
+        raise typer.Exit(code=1)
+
+    rank, (found_tk0, found_mk1) = found
+
+    if _xts_process_data(encrypted_data, found_tk0, found_mk1, True) != decrypted_data:
+        print(
+            "Candidate only matches the tweak index 6 block, data may be inconsistent"
+        )
+
+    key_e, tn = _xts_key_recovery(found_tk0, found_mk1)
+
+    table = Table(title=f"AES-XTS keys found at rank {rank}")
+    table.add_column("Name")
+    table.add_column("Value")
+
+    table.add_row("Tweaked key 6", found_tk0.hex())
+    table.add_row("Modified second decryption round key", found_mk1.hex())
+    table.add_row("Encryption key", key_e.hex())
+    table.add_row("Tweak 6", tn[6].hex())
+
+    print(table)
+
+
 @app.command()
 def process_xts(key_filename: Path):
     """Compute useful derivated keys from a AES-XTS key file."""
@@ -2,9 +2,11 @@
 """Gather traces with the EspCpaBoard."""
 
 import binascii
+import queue
 import random
 from pathlib import Path
-from typing import Any, Dict, List, Optional
+from threading import Event, Thread
+from typing import Any, Dict, List, Optional, Tuple, Union
 
 import cpa_lib
 import numpy as np
@@ -24,10 +26,16 @@ from typing_extensions import Annotated
 from esp_cpa_board import (
     EspCpaBoard,
     LiveSignalViewer,
+    SampleCodec,
     SignalPreprocessor,
     TempMonitorThread,
     load_config,
 )
+from esp_cpa_board.aes_utils import derivate_round_keys
+from esp_cpa_board.convergence import ConvergenceMonitor
+from esp_cpa_board.native_board import NativeEspCpaBoard
+from esp_cpa_board.simulated_board import SimulatedEspCpaBoard
+from esp_cpa_board.utils import poi_slices
 
 app = typer.Typer()
 
@@ -35,16 +43,25 @@ app = typer.Typer()
 class LiveKeyRanker:
     """Perform live key ranking."""
 
-    def __init__(self, key: bytes, config: Dict[str, Any]) -> None:
+    def __init__(
+        self,
+        key: Optional[bytes],
+        config: Dict[str, Any],
+        convergence_monitor: Optional[ConvergenceMonitor] = None,
+    ) -> None:
         """Instantiate a LiveKeyRanker object.
 
         Args:
-            key (bytes): The known AES round key to use for the ranking
+            key (Optional[bytes]): The known AES round key to use for the ranking, if any
             config: Configuration data for signal preprocessing
+            convergence_monitor (Optional[ConvergenceMonitor]): Monitor fed with the correlation values. Defaults to None.
         """
         self._key = key
+        self._convergence_monitor = convergence_monitor
+        self._n_traces = 0
 
         self._samples_preprocessor = SignalPreprocessor(config)
+        self._poi_slices = poi_slices(config)
 
         self._solvers = [
             cpa_lib.CpaSolver(
@@ -55,40 +72,77 @@ class LiveKeyRanker:
 
         self._payloads: list[bytes] = []
         self._samples: list[np.ndarray] = []
+        self._temperatures: list[Optional[float]] = []
 
         self._config = config
 
-    def feed(self, payload: bytes, samples: np.ndarray) -> None:
+    def feed(
+        self, payload: bytes, samples: np.ndarray, temperature: Optional[float] = None
+    ) -> None:
         """Feed samples.
 
         Args:
             payload (bytes): The input payload.
             samples (np.ndarray): The samples.
+            temperature (Optional[float]): The latest DUT temperature. Defaults to None.
         """
         self._payloads.append(payload[::-1])  # Reversed order
         self._samples.append(samples)
+        self._temperatures.append(temperature)
 
     def get_key_ranks(self) -> List[int]:
         """Get the key ranks, based on the past samples.
 
         Returns:
-            (List[int]): A list of key ranks, a list of best timestamps
+            (List[int]): A list of key ranks, empty if the key is unknown
         """
         samples = np.array(self._samples, float)
-        samples = self._samples_preprocessor.process(samples)
+        temperatures = None
+        if all(t is not None for t in self._temperatures):
+            temperatures = np.array(self._temperatures, float)
+        samples = self._samples_preprocessor.process(samples, temperatures)
+        self._n_traces += len(self._samples)
 
         rank_result = []
+        scores = np.zeros((16, 256))
         for i, s in enumerate(self._solvers):
-            s.update(self._payloads, samples)
+            s.update(self._payloads, samples[:, self._poi_slices[i]])
             mat = s.get_result()
-            rank = self._compute_key_rank(i, mat)
-            rank_result.append(rank)
+            scores[i] = np.max(np.abs(mat), axis=1)
+            if self._key is not None:
+                rank = self._compute_key_rank(i, mat)
+                rank_result.append(rank)
+
+        if self._convergence_monitor is not None:
+            self._convergence_monitor.update(scores, self._n_traces)
 
         self._payloads = []
         self._samples = []
+        self._temperatures = []
 
         return rank_result
 
+    @property
+    def converged(self) -> bool:
+        """Check if the monitored correlation values are converged.
+
+        Returns:
+            bool: True if all the bytes are converged
+        """
+        if self._convergence_monitor is None:
+            return False
+        return self._convergence_monitor.converged
+
+    def convergence_status(self) -> str:
+        """Get the convergence status.
+
+        Returns:
+            str: The status
+        """
+        if self._convergence_monitor is None:
+            return "No convergence monitor"
+        return self._convergence_monitor.status()
+
     def _compute_key_rank(self, i: int, mat: np.ndarray) -> int:
         """Compute the key rank at the give index.
 
@@ -132,6 +186,206 @@ progress = Progress(
 )
 
 
+# Complete chunk of measurements: board index, samples, payloads, temperatures
+Chunk = Tuple[int, np.ndarray, np.ndarray, np.ndarray]
+
+
+class BoardWorker(Thread):
+    """Acquisition loop of one board.
+
+    Measurements are gathered in complete chunks, which are handed over to the
+    writer through a queue. Workers claim chunks from a shared pool of tokens, so
+    that faster boards capture more chunks.
+    """
+
+    def __init__(
+        self,
+        board_index: int,
+        board: Union[EspCpaBoard, NativeEspCpaBoard, SimulatedEspCpaBoard],
+        measurement_config: Dict[str, Any],
+        temperature_thread: TempMonitorThread,
+        tokens: "queue.Queue[int]",
+        chunks: "queue.Queue[Union[Chunk, Exception, None]]",
+        stop_event: Event,
+        sync_step: int,
+        temp_rate: int,
+        progress_task: rich.progress.TaskID,
+        live_signal_viewer: Optional[LiveSignalViewer] = None,
+    ) -> None:
+        """Instantiate a BoardWorker object.
+
+        Args:
+            board_index (int): Index of the board, stored in the board-id column
+            board (Union[EspCpaBoard, NativeEspCpaBoard, SimulatedEspCpaBoard]): The connected board
+            measurement_config (Dict[str, Any]): The measurement configuration
+            temperature_thread (TempMonitorThread): The temperature monitor of the board
+            tokens (queue.Queue[int]): One token per chunk left to capture
+            chunks (queue.Queue[Union[Chunk, Exception, None]]): Output queue. An exception is queued on errors, and None at the end.
+            stop_event (Event): Set to stop the capture
+            sync_step (int): Number of measurements per chunk
+            temp_rate (int): Record a temperature data point each temp_rate measurements
+            progress_task (rich.progress.TaskID): The progress bar task to advance
+            live_signal_viewer (Optional[LiveSignalViewer]): Viewer to feed with the traces. Defaults to None.
+        """
+        super().__init__(daemon=True)
+        self._board_index = board_index
+        self._board = board
+        self._measurement_config = measurement_config
+        self._temperature_thread = temperature_thread
+        self._tokens = tokens
+        self._chunks = chunks
+        self._stop_event = stop_event
+        self._sync_step = sync_step
+        self._temp_rate = temp_rate
+        self._progress_task = progress_task
+        self._live_signal_viewer = live_signal_viewer
+
+    def run(self) -> None:
+        try:
+            # Repeat the latest value when the monitor has no new one, so that
+            # temperatures stay aligned with their chunk
+            temperature = self._board.get_temperature()
+            while not self._stop_event.is_set():
+                try:
+                    self._tokens.get_nowait()
+                except queue.Empty:
+                    break
+                chunk = self._capture_chunk(temperature)
+                if chunk is None:
+                    break
+                temperature = float(chunk[3][-1])
+                self._chunks.put(chunk)
+        except Exception as e:
+            self._chunks.put(e)
+        finally:
+            self._chunks.put(None)
+
+    def _capture_chunk(self, temperature: float) -> Optional[Chunk]:
+        if isinstance(self._board, NativeEspCpaBoard):
+            return self._capture_native_chunk(temperature)
+
+        config = self._measurement_config
+        samples_chunk = np.zeros(
+            shape=(self._sync_step, config["averaging"], config["n_samples"]),
+            dtype=np.int16,
+        )
+        payloads_chunk = np.zeros(shape=(self._sync_step, 16), dtype=np.uint8)
+        temperatures_chunk = np.zeros(self._sync_step // self._temp_rate, dtype="f")
+
+        for i in range(self._sync_step):
+            if self._stop_event.is_set():
+                return None
+
+            payload = random.randbytes(16)
+
+            self._board.set_flash_payload(payload)
+
+            samples = self._board.perform_measurement(
+                n_samples=config["n_samples"],
+                n_measurements=config["averaging"],
+            )
+            assert samples.shape == (
+                config["averaging"],
+                config["n_samples"],
+            ), f"Invalid number of samples ({samples.shape})"
+
+            samples_chunk[i] = samples
+            payloads_chunk[i] = [n for n in payload]
+
+            # Fill temperature buffer
+            if i % self._temp_rate == 0:
+                temp = self._temperature_thread.get_temp()
+                if temp is not None:
+                    temperature = temp
+                temperatures_chunk[i // self._temp_rate] = temperature
+
+            progress.advance(self._progress_task)
+
+            if self._live_signal_viewer is not None:
+                self._live_signal_viewer.feed(np.mean(samples, axis=0))
+
+        return self._board_index, samples_chunk, payloads_chunk, temperatures_chunk
+
+    def _capture_native_chunk(self, temperature: float) -> Optional[Chunk]:
+        assert isinstance(self._board, NativeEspCpaBoard)
+
+        # The capture loop runs in the Rust library, temp_rate measurements at a
+        # time, so that temperatures and progress are still sampled along the way
+        samples_parts = []
+        payloads_parts = []
+        temperatures_chunk = np.zeros(self._sync_step // self._temp_rate, dtype="f")
+
+        for i in range(self._sync_step // self._temp_rate):
+            if self._stop_event.is_set():
+                return None
+
+            temp = self._temperature_thread.get_temp()
+            if temp is not None:
+                temperature = temp
+            temperatures_chunk[i] = temperature
+
+            payloads, samples = self._board.capture_chunk(self._temp_rate)
+            payloads_parts.append(payloads)
+            samples_parts.append(samples)
+
+            progress.advance(self._progress_task, self._temp_rate)
+
+            if self._live_signal_viewer is not None:
+                self._live_signal_viewer.feed(np.mean(samples[-1], axis=0))
+
+        return (
+            self._board_index,
+            np.concatenate(samples_parts),
+            np.concatenate(payloads_parts),
+            temperatures_chunk,
+        )
+
+
+def _open_boards(
+    measurement_config: Dict[str, Any],
+    boards: Optional[List[str]],
+    all_boards: bool,
+    simulate: Optional[Path],
+    simulated_measurement_time: float,
+    native: bool,
+) -> List[Union[EspCpaBoard, NativeEspCpaBoard, SimulatedEspCpaBoard]]:
+    """Instantiate the boards to capture with.
+
+    Args:
+        measurement_config (Dict[str, Any]): The measurement configuration
+        boards (Optional[List[str]]): Bus paths or serial numbers of the boards
+        all_boards (bool): Use all the connected boards
+        simulate (Optional[Path]): XTS key file of simulated boards
+        simulated_measurement_time (float): Emulated duration of a simulated measurement
+        native (bool): Capture with the native engine of cpa_lib
+
+    Returns:
+        List[Union[EspCpaBoard, NativeEspCpaBoard, SimulatedEspCpaBoard]]: The boards, not connected yet
+    """
+    if simulate is not None:
+        round_key = derivate_round_keys(simulate)[0]
+        names = boards or [p for p, _ in SimulatedEspCpaBoard.list_devices()]
+        return [
+            SimulatedEspCpaBoard(
+                measurement_config,
+                round_key,
+                device=name,
+                measurement_time=simulated_measurement_time,
+            )
+            for name in names
+        ]
+
+    if all_boards:
+        boards = [path for path, _ in EspCpaBoard.list_devices()]
+        if not boards:
+            raise typer.BadParameter("No board found")
+
+    board_class = NativeEspCpaBoard if native else EspCpaBoard
+    if not boards:
+        return [board_class(measurement_config)]
+    return [board_class(measurement_config, device=board) for board in boards]
+
+
 @app.command()
 def main(
     measurement_config_filename: Path,
@@ -145,10 +399,48 @@ def main(
         typer.Option(help="The configuration file to use for live key ranking"),
     ] = None,
     gui_display: bool = False,
+    early_stop: Annotated[
+        bool,
+        typer.Option(help="Stop the capture once the best guesses are settled"),
+    ] = False,
+    min_margin: float = 5.0,
+    stable_steps: int = 10,
+    confidence: Optional[float] = None,
+    board: Annotated[
+        Optional[List[str]],
+        typer.Option(
+            help="Bus path (e.g. 1-2.3) or serial number of a board to capture with, can be repeated"
+        ),
+    ] = None,
+    all_boards: Annotated[
+        bool, typer.Option(help="Capture with all the connected boards")
+    ] = False,
+    simulate: Annotated[
+        Optional[Path],
+        typer.Option(
+            help="Capture with simulated boards, leaking the round 0 key of this XTS key file"
+        ),
+    ] = None,
+    simulated_measurement_time: Annotated[
+        float,
+        typer.Option(help="Emulated duration of a simulated measurement, in seconds"),
+    ] = 0.0,
+    native: Annotated[
+        bool,
+        typer.Option(
+            help="Run the capture loop in the native engine of cpa_lib (boards must be configured with ctrl beforehand)"
+        ),
+    ] = False,
 ) -> None:
-    """Perform a measurement campaign."""
+    """Perform a measurement campaign.
+
+    With several boards, one acquisition worker runs per board. Each chunk of
+    measurements comes from a single board, and chunks are interleaved in the
+    output, with a board-id column (boards) indexing the attrs["boards"] list.
+    """
     measurement_config = load_config(measurement_config_filename)
 
+    raw_key = None
     if key is not None:
         try:
             raw_key = binascii.unhexlify(key)
@@ -156,41 +448,73 @@ def main(
             raise typer.BadParameter("Invalid key format")
         if len(raw_key) != 16:
             raise typer.BadParameter("The size of the key is expected to be 16 bytes")
+
+    convergence_monitor = None
+    if early_stop:
+        convergence_monitor = ConvergenceMonitor(min_margin, stable_steps, confidence)
+
+    if raw_key is not None or convergence_monitor is not None:
         if analysis_config_filename is not None:
             live_key_ranker = LiveKeyRanker(
-                raw_key, load_config(analysis_config_filename)
+                raw_key, load_config(analysis_config_filename), convergence_monitor
             )
         else:
             raise typer.BadParameter("Missing analysis configuration")
     else:
         live_key_ranker = None
 
+    boards = _open_boards(
+        measurement_config,
+        board,
+        all_boards,
+        simulate,
+        simulated_measurement_time,
+        native,
+    )
+    if len(boards) > 255:
+        raise typer.BadParameter("Too many boards")
+
     if gui_display:
         live_signal_viewer = LiveSignalViewer()
     else:
         live_signal_viewer = None
 
-    board = EspCpaBoard(measurement_config)
-
-    board.connect()
-    board.set_dut_power(True)
-    board.set_clk_en(True)
-    board.set_amplifier_gain(measurement_config["amplifier_gain"])
-
-    temp_monitor_args: Dict[str, Any] = {}
-
-    if measurement_config["dut_temperature"] is not None:
-        temp_monitor_args["target_temperature"] = measurement_config["dut_temperature"]
-
-    if live_signal_viewer is not None:
-        temp_monitor_args["callback"] = live_signal_viewer.add_temperature
-
-    temperature_thread = TempMonitorThread(board, **temp_monitor_args)
-    temperature_thread.start()
+    temperature_threads = []
+    for n, b in enumerate(boards):
+        b.connect()
+        b.set_dut_power(True)
+        b.set_clk_en(True)
+        b.set_amplifier_gain(measurement_config["amplifier_gain"])
+
+        temp_monitor_args: Dict[str, Any] = {}
+
+        if measurement_config["dut_temperature"] is not None:
+            temp_monitor_args["target_temperature"] = measurement_config[
+                "dut_temperature"
+            ]
+
+        # The GUI follows the first board only
+        if live_signal_viewer is not None and n == 0:
+            temp_monitor_args["callback"] = live_signal_viewer.add_temperature
+
+        temperature_thread = TempMonitorThread(b, **temp_monitor_args)
+        temperature_thread.start()
+        temperature_threads.append(temperature_thread)
+
+    sync_step = 5000  # Compute live key ranks each sync_step samples
+    temp_rate = 100  # Record a temperature data point each temp_rate sample
+
+    n_chunks = measurement_config["n_measurements"] // sync_step
+    tokens: "queue.Queue[int]" = queue.Queue()
+    for n in range(n_chunks):
+        tokens.put(n)
+    chunks: "queue.Queue[Union[Chunk, Exception, None]]" = queue.Queue(
+        maxsize=2 * len(boards)
+    )
+    stop_event = Event()
+    workers: List[BoardWorker] = []
 
     try:
-        sync_step = 5000  # Compute live key ranks each sync_step samples
-        temp_rate = 100  # Record a temperature data point each temp_rate sample
         with zarr.open(output_filename, "w-") as output_f:
             samples_array = output_f.create_dataset(
                 "samples",
@@ -200,6 +524,7 @@ def main(
                     measurement_config["n_samples"],
                 ),
                 dtype="i2",
+                compressor=SampleCodec(),
                 chunks=(
                     sync_step,
                     measurement_config["averaging"],
@@ -219,50 +544,70 @@ def main(
                 chunks=(sync_step // temp_rate,),
                 dtype="f",
             )
-
-            samples_chunk = np.zeros(
-                shape=(
-                    sync_step,
-                    measurement_config["averaging"],
-                    measurement_config["n_samples"],
-                ),
-                dtype=np.int16,
+            boards_array = output_f.create_dataset(
+                "boards",
+                shape=(0,),
+                chunks=(sync_step,),
+                dtype="u1",
             )
-            payloads_chunk = np.zeros(shape=(sync_step, 16), dtype=np.uint8)
+            output_f.attrs["boards"] = [
+                b.device if b.device is not None else str(n)
+                for n, b in enumerate(boards)
+            ]
 
             with progress:
-                for i in progress.track(range(measurement_config["n_measurements"])):
-                    payload = random.randbytes(16)
-
-                    board.set_flash_payload(payload)
-
-                    samples = board.perform_measurement(
-                        n_samples=measurement_config["n_samples"],
-                        n_measurements=measurement_config["averaging"],
+                progress_task = progress.add_task("Capture", total=n_chunks * sync_step)
+
+                for n, (b, temperature_thread) in enumerate(
+                    zip(boards, temperature_threads)
+                ):
+                    worker = BoardWorker(
+                        n,
+                        b,
+                        measurement_config,
+                        temperature_thread,
+                        tokens,
+                        chunks,
+                        stop_event,
+                        sync_step,
+                        temp_rate,
+                        progress_task,
+                        live_signal_viewer if n == 0 else None,
                     )
-                    assert samples.shape == (
-                        measurement_config["averaging"],
-                        measurement_config["n_samples"],
-                    ), f"Invalid number of samples ({samples.shape})"
-
-                    samples_chunk[i % sync_step] = samples
-                    payloads_chunk[i % sync_step] = [n for n in payload]
-
-                    # Fill temperature buffer
-                    if i % temp_rate == 0:
-                        temp = temperature_thread.get_temp()
-                        if temp is not None:
-                            temperatures_array.append((temp,))
+                    worker.start()
+                    workers.append(worker)
+
+                n_running = len(workers)
+                n_written = 0
+                while n_running:
+                    chunk = chunks.get()
+                    if chunk is None:
+                        n_running -= 1
+                        continue
+                    if isinstance(chunk, Exception):
+                        stop_event.set()
+                        raise chunk
+                    if stop_event.is_set():
+                        continue
+
+                    board_index, samples_chunk, payloads_chunk, temps = chunk
 
                     # Fill zarr buffers
-                    if (i + 1) % sync_step == 0:
-                        samples_array.append(samples_chunk)
-                        payloads_array.append(payloads_chunk)
+                    samples_array.append(samples_chunk)
+                    payloads_array.append(payloads_chunk)
+                    temperatures_array.append(temps)
+                    boards_array.append(np.full(sync_step, board_index, dtype="u1"))
+                    n_written += sync_step
 
                     if live_key_ranker is not None:
-                        live_key_ranker.feed(payload, samples)
-                        if (i + 1) % sync_step == 0:
-                            ranks = live_key_ranker.get_key_ranks()
+                        for i in range(sync_step):
+                            live_key_ranker.feed(
+                                payloads_chunk[i].tobytes(),
+                                samples_chunk[i],
+                                float(temps[i // temp_rate]),
+                            )
+                        ranks = live_key_ranker.get_key_ranks()
+                        if ranks:
                             average_rank = np.mean(ranks)
                             progress.console.print(
                                 f"Average rank = {average_rank:0.1f}"
@@ -270,16 +615,33 @@ def main(
                             progress.console.print(f"    {ranks}")
                             if live_signal_viewer:
                                 live_signal_viewer.add_ranking(average_rank)
-
-                    if live_signal_viewer is not None:
-                        live_signal_viewer.feed(np.mean(samples, axis=0))
+                        if convergence_monitor is not None:
+                            progress.console.print(live_key_ranker.convergence_status())
+                            if live_key_ranker.converged:
+                                progress.console.print(
+                                    f"Converged after {n_written} measurements"
+                                )
+                                stop_event.set()
 
     except KeyboardInterrupt:
         pass
-
-    temperature_thread.stop()
-    board.set_clk_en(False)
-    board.set_dut_power(False)
+    finally:
+        stop_event.set()
+        # Unblock the workers waiting for room in the queue
+        while any(w.is_alive() for w in workers):
+            try:
+                chunks.get(timeout=0.1)
+            except queue.Empty:
+                pass
+
+        # Temperature threads are not daemons, the process can't exit without this
+        for temperature_thread in temperature_threads:
+            temperature_thread.stop()
+        if live_signal_viewer is not None:
+            live_signal_viewer.close()
+        for b in boards:
+            b.set_clk_en(False)
+            b.set_dut_power(False)
 
 
 if __name__ == "__main__":
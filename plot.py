@@ -1,18 +1,21 @@
 #!/usr/bin/env python3
 """Plot analysis results."""
 
+from binascii import unhexlify
 from pathlib import Path
 from types import SimpleNamespace
-from typing import List, Optional
+from typing import Annotated, Any, List, Optional
 
 import numpy as np
 import pandas as pd
 import plotly.express as px
 import plotly.graph_objects as go
 import typer
+import zarr
 from plotly.subplots import make_subplots
 
 from esp_cpa_board.aes_utils import AesDecryptOperationType
+from esp_cpa_board.downsampling import downsample
 
 app = typer.Typer()
 
@@ -64,6 +67,53 @@ def plot_ranks(ctx: typer.Context, input_file: Path):
     _render(ctx, fig)
 
 
+@app.command()
+def plot_success_rate(
+    ctx: typer.Context, input_file: Path, metric: str = "Success Rate"
+):
+    """Plot the success rate (or guessing entropy) evolution, with confidence intervals."""
+    df = pd.read_csv(input_file).dropna(subset=[metric])
+
+    fig = go.Figure()
+    colors = px.colors.qualitative.Plotly
+    for n, (name, group) in enumerate(df.groupby("Name", sort=False)):
+        color = colors[n % len(colors)]
+        x = group["Measurement Index"]
+        fig.add_trace(
+            go.Scatter(
+                x=pd.concat([x, x[::-1]]),
+                y=pd.concat(
+                    [
+                        group[f"{metric} Upper Bound"],
+                        group[f"{metric} Lower Bound"][::-1],
+                    ]
+                ),
+                fill="toself",
+                fillcolor=color,
+                opacity=0.2,
+                line=dict(width=0),
+                hoverinfo="skip",
+                showlegend=False,
+                legendgroup=name,
+            )
+        )
+        fig.add_trace(
+            go.Scatter(
+                x=x,
+                y=group[metric],
+                name=name,
+                line=dict(color=color),
+                legendgroup=name,
+            )
+        )
+
+    fig.update_layout(title=ctx.obj.graph_title)
+    fig.update_xaxes(title_text="Measurement Index")
+    fig.update_yaxes(title_text=metric)
+
+    _render(ctx, fig)
+
+
 @app.command()
 def plot_traces(ctx: typer.Context, input_file: Path):
     """Plot the rank evolution of each byte."""
@@ -117,27 +167,154 @@ def plot_spread(ctx: typer.Context, input_file: Path, pruning_rate: float = 0.9)
     _render(ctx, fig)
 
 
-@app.command()
-def plot_correlations(ctx: typer.Context, input_file: Path, step_size: int = 50_000):
-    """Plot the correlation coefficients evolution of each guess."""
-    df = pd.read_csv(input_file)
+def _correlation_traces(
+    corr: Any,
+    byte_index: int,
+    time_index: Optional[int],
+    correct_guess: Optional[int],
+    downsampling: str,
+    max_points: int,
+) -> List[go.Scattergl]:
+    """Build the traces of the correlation evolution of each guess of a byte.
+
+    Wrong guesses are downsampled, and drawn as a single trace with gaps between
+    the guesses. The correct guess keeps its full resolution.
+
+    Args:
+        corr (Any): The correlation results, shaped (16, n_steps, 256, n_poi)
+        byte_index (int): The key byte
+        time_index (Optional[int]): The POI to plot, None for the best one of each step
+        correct_guess (Optional[int]): The correct guess, if known
+        downsampling (str): "lttb", "minmax" or "none", see `downsample`
+        max_points (int): Number of points to keep per wrong guess
+
+    Returns:
+        List[go.Scattergl]: The traces
+    """
+    if time_index is None:
+        values = np.max(np.abs(corr[byte_index]), axis=2)
+    else:
+        values = np.abs(corr[byte_index, :, :, time_index])
+    values = values.T.astype(np.float32)  # (256, n_steps)
+
+    x = (np.arange(values.shape[1]) + 1) * corr.attrs.get("chunk_size", 5000)
+    guesses = np.array([g for g in range(256) if g != correct_guess])
+    xs, ys = downsample(x, values[guesses], max_points, downsampling)
+
+    # NaN separated series render as one WebGL trace
+    gaps = np.full((len(guesses), 1), np.nan)
+    traces = [
+        go.Scattergl(
+            x=np.hstack([xs, gaps]).ravel().astype(np.float32),
+            y=np.hstack([ys, gaps]).ravel(),
+            customdata=np.repeat(guesses, xs.shape[1] + 1).astype(np.uint8),
+            hovertemplate="Guess %{customdata}: %{y}<extra></extra>",
+            mode="lines",
+            line=dict(color="grey", width=1),
+            name="Wrong Guesses" if correct_guess is not None else "Guesses",
+            legendgroup="guesses",
+        )
+    ]
+    if correct_guess is not None:
+        traces.append(
+            go.Scattergl(
+                x=x,
+                y=values[correct_guess],
+                mode="lines",
+                line=dict(color="red"),
+                name="Correct Guess",
+                legendgroup="correct",
+            )
+        )
+    return traces
 
-    fig = px.line(
-        df[df["Measurement Index"] % step_size == 0],
-        x="Measurement Index",
-        y="Correlation Value",
-        color="Name",
-        facet_col="Byte",
-        facet_col_wrap=4,
-        title=ctx.obj.graph_title,
-        height=800,
+
+def _plot_correlations(
+    ctx: typer.Context,
+    input_file: Path,
+    byte_indexes: List[int],
+    n_cols: int,
+    time_index: Optional[int],
+    key: Optional[str],
+    downsampling: str,
+    max_points: int,
+    height: Optional[int] = None,
+):
+    """Plot the correlation evolution of the guesses of several bytes, one subplot per byte."""
+    if downsampling not in ("lttb", "minmax", "none"):
+        raise typer.BadParameter(f"Unknown downsampling method {downsampling}")
+
+    raw_key = None
+    if key is not None:
+        raw_key = unhexlify(key)
+        if len(raw_key) != 16:
+            raise typer.BadParameter(
+                "The size of the round key is expected to be 16 bytes"
+            )
+
+    corr = zarr.open(input_file, "r")
+
+    n_rows = (len(byte_indexes) + n_cols - 1) // n_cols
+    fig = make_subplots(
+        rows=n_rows,
+        cols=n_cols,
+        subplot_titles=[f"Byte {j}" for j in byte_indexes],
+        shared_yaxes=True,
     )
-    fig.update_traces(line=dict(color="grey"))
-    fig.update_traces(line=dict(color="red"), selector=dict(name="Correct Guess"))
+    for n, j in enumerate(byte_indexes):
+        traces = _correlation_traces(
+            corr,
+            j,
+            time_index,
+            None if raw_key is None else raw_key[j],
+            downsampling,
+            max_points,
+        )
+        for trace in traces:
+            trace.showlegend = n == 0
+            fig.add_trace(trace, row=n // n_cols + 1, col=n % n_cols + 1)
+
+    fig.update_layout(title=ctx.obj.graph_title, height=height)
+    fig.update_xaxes(title_text="Measurement Index", row=n_rows)
+    fig.update_yaxes(title_text="Correlation Value", col=1)
 
     _render(ctx, fig)
 
 
+@app.command()
+def plot_correlations(
+    ctx: typer.Context,
+    input_file: Path,
+    time_index: Annotated[
+        Optional[int], typer.Option(help="The POI to plot, the best one by default")
+    ] = None,
+    key: Annotated[
+        Optional[str],
+        typer.Option(help="The round key, if known, to highlight the correct trace"),
+    ] = None,
+    downsampling: Annotated[
+        str, typer.Option(help="Downsampling method: lttb, minmax or none")
+    ] = "lttb",
+    max_points: int = 200,
+):
+    """Plot the correlation coefficients evolution of each guess, from correlation results.
+
+    Wrong guesses are downsampled to max_points points each, the correct guess is
+    plotted at full resolution.
+    """
+    _plot_correlations(
+        ctx,
+        input_file,
+        list(range(16)),
+        4,
+        time_index,
+        key,
+        downsampling,
+        max_points,
+        height=800,
+    )
+
+
 @app.command()
 def plot_leakages(ctx: typer.Context, input_file: Path):
     """Plot data from the leakage assessment results."""
@@ -189,34 +366,32 @@ def plot_leakages(ctx: typer.Context, input_file: Path):
 
 @app.command()
 def plot_correlations_at_index(
-    ctx: typer.Context, input_file: Path, byte_index: List[int], step_size: int = 10_000
+    ctx: typer.Context,
+    input_file: Path,
+    byte_index: List[int],
+    time_index: Annotated[
+        Optional[int], typer.Option(help="The POI to plot, the best one by default")
+    ] = None,
+    key: Annotated[
+        Optional[str],
+        typer.Option(help="The round key, if known, to highlight the correct trace"),
+    ] = None,
+    downsampling: Annotated[
+        str, typer.Option(help="Downsampling method: lttb, minmax or none")
+    ] = "lttb",
+    max_points: int = 1000,
 ):
-    """Plot the correlation coefficients evolution of each guess."""
-    df = pd.read_csv(input_file)
-
-    df = df[df["Measurement Index"] % step_size == 0]
-
-    if len(byte_index) == 1:
-        fig = px.line(
-            df[df["Byte"] == byte_index[0]],
-            x="Measurement Index",
-            y="Correlation Value",
-            color="Name",
-            title=ctx.obj.graph_title,
-        )
-    else:
-        fig = px.line(
-            df[df["Byte"].isin(byte_index)],
-            x="Measurement Index",
-            y="Correlation Value",
-            color="Name",
-            facet_col="Byte",
-            title=ctx.obj.graph_title,
-        )
-    fig.update_traces(line=dict(color="grey"))
-    fig.update_traces(line=dict(color="red"), selector=dict(name="Correct Guess"))
-
-    _render(ctx, fig)
+    """Plot the correlation coefficients evolution of each guess, for the given bytes."""
+    _plot_correlations(
+        ctx,
+        input_file,
+        byte_index,
+        len(byte_index),
+        time_index,
+        key,
+        downsampling,
+        max_points,
+    )
 
 
 @app.command()
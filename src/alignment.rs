@@ -0,0 +1,192 @@
+use std::thread;
+
+// Align traces on a reference pattern.
+// The pattern is searched around its expected offset by normalized
+// cross-correlation, with a parabolic interpolation of the correlation peak to
+// get sub-sample shifts. Optionally, the aligned window is then elastically
+// warped onto the pattern (dynamic time warping in a Sakoe-Chiba band).
+pub struct AlignmentEngine {
+    reference: Vec<f64>, // Zero mean, unit norm
+    offset: usize,
+    max_shift: usize,
+    elastic_radius: usize,
+}
+
+fn n_threads() -> usize {
+    thread::available_parallelism()
+        .map(|n| n.get())
+        .unwrap_or(1)
+}
+
+fn normalize(x: &[f64]) -> Vec<f64> {
+    let mean = x.iter().sum::<f64>() / x.len() as f64;
+    let centered: Vec<f64> = x.iter().map(|v| v - mean).collect();
+    let norm = centered.iter().map(|v| v * v).sum::<f64>().sqrt();
+    if norm > 0.0 {
+        centered.iter().map(|v| v / norm).collect()
+    } else {
+        centered
+    }
+}
+
+// Value of x at the (fractional) position t, clamped to the trace boundaries
+fn interpolate(x: &[f64], t: f64) -> f64 {
+    let t = t.clamp(0.0, (x.len() - 1) as f64);
+    let i = t.floor() as usize;
+    let frac = t - i as f64;
+    if i + 1 < x.len() {
+        x[i] * (1.0 - frac) + x[i + 1] * frac
+    } else {
+        x[i]
+    }
+}
+
+impl AlignmentEngine {
+    pub fn new(reference: &[f64], offset: usize, max_shift: usize, elastic_radius: usize) -> Self {
+        AlignmentEngine {
+            reference: normalize(reference),
+            offset,
+            max_shift,
+            elastic_radius,
+        }
+    }
+
+    // The whole search window must fit in the traces, otherwise some (or all)
+    // shifts could not be evaluated
+    pub fn check_length(&self, n_samples: usize) -> Result<(), String> {
+        let end = self.offset + self.reference.len() + self.max_shift;
+        if self.offset < self.max_shift || end > n_samples {
+            return Err(format!(
+                "The alignment search window ({}..{}) does not fit in traces of {} samples",
+                self.offset as i64 - self.max_shift as i64,
+                end,
+                n_samples
+            ));
+        }
+        Ok(())
+    }
+
+    fn correlation(&self, x: &[f64], start: usize) -> f64 {
+        let window = normalize(&x[start..start + self.reference.len()]);
+        window
+            .iter()
+            .zip(self.reference.iter())
+            .map(|(a, b)| a * b)
+            .sum()
+    }
+
+    // Shift (in samples) to apply to x so that it matches the reference
+    fn find_shift(&self, x: &[f64]) -> f64 {
+        let length = self.reference.len();
+        let max_shift = self.max_shift as i64;
+
+        let scores: Vec<(i64, f64)> = (-max_shift..=max_shift)
+            .filter_map(|s| {
+                let start = self.offset as i64 + s;
+                if start < 0 || start as usize + length > x.len() {
+                    return None;
+                }
+                Some((s, self.correlation(x, start as usize)))
+            })
+            .collect();
+
+        let Some(best) = (0..scores.len()).max_by(|&a, &b| scores[a].1.total_cmp(&scores[b].1))
+            else {
+                return 0.0;
+            };
+
+        // Parabolic interpolation of the correlation peak
+        let mut delta = 0.0;
+        if best > 0 && best + 1 < scores.len() {
+            let (l, c, r) = (scores[best - 1].1, scores[best].1, scores[best + 1].1);
+            let denominator = l - 2.0 * c + r;
+            if denominator < 0.0 {
+                delta = (0.5 * (l - r) / denominator).clamp(-0.5, 0.5);
+            }
+        }
+
+        scores[best].0 as f64 + delta
+    }
+
+    // Warp the pattern window of x onto the reference. Each reference sample
+    // receives the mean of the trace samples it is matched with.
+    fn warp(&self, x: &mut [f64]) {
+        let length = self.reference.len();
+        if self.offset + length > x.len() {
+            return;
+        }
+        let window = normalize(&x[self.offset..self.offset + length]);
+        let radius = self.elastic_radius;
+
+        let mut cost = vec![f64::INFINITY; (length + 1) * (length + 1)];
+        let at = |i: usize, j: usize| i * (length + 1) + j;
+        cost[at(0, 0)] = 0.0;
+        for i in 1..=length {
+            let lo = i.saturating_sub(radius).max(1);
+            let hi = (i + radius).min(length);
+            for j in lo..=hi {
+                let d = self.reference[i - 1] - window[j - 1];
+                let best = cost[at(i - 1, j - 1)]
+                    .min(cost[at(i - 1, j)])
+                    .min(cost[at(i, j - 1)]);
+                cost[at(i, j)] = d * d + best;
+            }
+        }
+
+        // Backtrack the warping path
+        let mut sums = vec![0.0f64; length];
+        let mut counts = vec![0usize; length];
+        let (mut i, mut j) = (length, length);
+        while i > 0 && j > 0 {
+            sums[i - 1] += x[self.offset + j - 1];
+            counts[i - 1] += 1;
+
+            let diagonal = cost[at(i - 1, j - 1)];
+            let up = cost[at(i - 1, j)];
+            let left = cost[at(i, j - 1)];
+            if diagonal <= up && diagonal <= left {
+                i -= 1;
+                j -= 1;
+            } else if up <= left {
+                i -= 1;
+            } else {
+                j -= 1;
+            }
+        }
+
+        for (k, (s, n)) in sums.iter().zip(counts.iter()).enumerate() {
+            if *n > 0 {
+                x[self.offset + k] = s / *n as f64;
+            }
+        }
+    }
+
+    fn align_trace(&self, x: &[f64]) -> (Vec<f64>, f64) {
+        let shift = self.find_shift(x);
+        let mut aligned: Vec<f64> = (0..x.len())
+            .map(|t| interpolate(x, t as f64 + shift))
+            .collect();
+        if self.elastic_radius > 0 {
+            self.warp(&mut aligned);
+        }
+        (aligned, shift)
+    }
+
+    // Aligned traces, and the shift applied to each of them
+    pub fn align(&self, samples: &[Vec<f64>]) -> (Vec<Vec<f64>>, Vec<f64>) {
+        let chunk_len = (samples.len() + n_threads() - 1) / n_threads();
+        if chunk_len == 0 {
+            return (Vec::new(), Vec::new());
+        }
+
+        let partials: Vec<Vec<(Vec<f64>, f64)>> = thread::scope(|scope| {
+            let handles: Vec<_> = samples
+                .chunks(chunk_len)
+                .map(|s| scope.spawn(move || s.iter().map(|x| self.align_trace(x)).collect()))
+                .collect();
+            handles.into_iter().map(|h| h.join().unwrap()).collect()
+        });
+
+        partials.into_iter().flatten().unzip()
+    }
+}
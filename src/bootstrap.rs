@@ -0,0 +1,265 @@
+use std::collections::hash_map::RandomState;
+use std::error::Error;
+use std::hash::{BuildHasher, Hasher};
+use std::thread;
+
+use super::power_consumption_models::ConsumptionModelTrait;
+
+const N_GUESSES: usize = 256;
+
+// Correlation sums of one block of traces, for one key byte. Sums of
+// several blocks merge into the sums of their union.
+#[derive(Clone)]
+struct BlockMoments {
+    duration: usize,
+    n: f64,
+    sum_x: Vec<f64>,  // duration
+    sum_xx: Vec<f64>, // duration
+    sum_h: Vec<f64>,  // N_GUESSES
+    sum_hh: Vec<f64>, // N_GUESSES
+    sum_xh: Vec<f64>, // N_GUESSES x duration
+}
+
+impl BlockMoments {
+    fn new(duration: usize) -> Self {
+        BlockMoments {
+            duration,
+            n: 0.0,
+            sum_x: vec![0.0; duration],
+            sum_xx: vec![0.0; duration],
+            sum_h: vec![0.0; N_GUESSES],
+            sum_hh: vec![0.0; N_GUESSES],
+            sum_xh: vec![0.0; N_GUESSES * duration],
+        }
+    }
+
+    fn update(
+        &mut self,
+        model: &dyn ConsumptionModelTrait,
+        payloads: &[[u8; 16]],
+        samples: &[Vec<f64>],
+        index: usize,
+    ) {
+        for (p, x) in payloads.iter().zip(samples.iter()) {
+            self.n += 1.0;
+            for ((s, ss), v) in self.sum_x.iter_mut().zip(self.sum_xx.iter_mut()).zip(x) {
+                *s += v;
+                *ss += v * v;
+            }
+
+            let h = model.estimate_all(p, index);
+            for (g, hg) in h.iter().enumerate() {
+                self.sum_h[g] += hg;
+                self.sum_hh[g] += hg * hg;
+                let row = &mut self.sum_xh[g * self.duration..(g + 1) * self.duration];
+                for (sxh, v) in row.iter_mut().zip(x) {
+                    *sxh += hg * v;
+                }
+            }
+        }
+    }
+
+    fn merge(&mut self, other: &BlockMoments) {
+        self.n += other.n;
+        let pairs = [
+            (&mut self.sum_x, &other.sum_x),
+            (&mut self.sum_xx, &other.sum_xx),
+            (&mut self.sum_h, &other.sum_h),
+            (&mut self.sum_hh, &other.sum_hh),
+            (&mut self.sum_xh, &other.sum_xh),
+        ];
+        for (a, b) in pairs {
+            for (a, b) in a.iter_mut().zip(b.iter()) {
+                *a += b;
+            }
+        }
+    }
+
+    fn reset(&mut self) {
+        self.n = 0.0;
+        for v in [
+            &mut self.sum_x,
+            &mut self.sum_xx,
+            &mut self.sum_h,
+            &mut self.sum_hh,
+            &mut self.sum_xh,
+        ] {
+            v.fill(0.0);
+        }
+    }
+
+    // Highest absolute correlation over the samples, for each guess
+    fn scores(&self) -> Vec<f64> {
+        let n = self.n;
+        let var_x: Vec<f64> = self
+            .sum_x
+            .iter()
+            .zip(self.sum_xx.iter())
+            .map(|(s, ss)| n * ss - s * s)
+            .collect();
+
+        (0..N_GUESSES)
+            .map(|g| {
+                let var_h = n * self.sum_hh[g] - self.sum_h[g] * self.sum_h[g];
+                let row = &self.sum_xh[g * self.duration..(g + 1) * self.duration];
+                row.iter()
+                    .zip(self.sum_x.iter())
+                    .zip(var_x.iter())
+                    .map(|((sxh, sx), vx)| {
+                        let den = (vx * var_h).sqrt();
+                        if den > 0.0 {
+                            ((n * sxh - sx * self.sum_h[g]) / den).abs()
+                        } else {
+                            0.0
+                        }
+                    })
+                    .fold(0.0, f64::max)
+            })
+            .collect()
+    }
+
+    // Number of guesses scoring better than the right one
+    fn rank(&self, key: u8) -> u16 {
+        let scores = self.scores();
+        let reference = scores[key as usize];
+        scores.iter().filter(|&&s| s > reference).count() as u16
+    }
+}
+
+// Permutations only need to be unpredictable enough for resampling
+struct XorShift(u64);
+
+impl XorShift {
+    fn new(seed: Option<u64>) -> Self {
+        let seed = seed.unwrap_or_else(|| {
+            let mut hasher = RandomState::new().build_hasher();
+            hasher.write_u64(0);
+            hasher.finish()
+        });
+        // Scramble, so that close seeds give unrelated sequences
+        XorShift(seed.wrapping_mul(0x9e3779b97f4a7c15) | 1)
+    }
+
+    fn next(&mut self) -> u64 {
+        self.0 ^= self.0 << 13;
+        self.0 ^= self.0 >> 7;
+        self.0 ^= self.0 << 17;
+        self.0.wrapping_mul(0x2545f4914f6cdd1d)
+    }
+
+    fn shuffle(&mut self, values: &mut [usize]) {
+        for i in (1..values.len()).rev() {
+            let j = (self.next() % (i as u64 + 1)) as usize;
+            values.swap(i, j);
+        }
+    }
+}
+
+// Key ranks over random orderings of the traces. The capture is read once:
+// the correlation sums of each block of traces are kept, and any ordering of
+// the blocks is replayed by merging them.
+pub struct BootstrapEngine {
+    duration: usize,
+    block_size: usize,
+    blocks: Vec<Vec<BlockMoments>>, // n_blocks x 16
+}
+
+impl BootstrapEngine {
+    pub fn new(duration: usize) -> Self {
+        BootstrapEngine {
+            duration,
+            block_size: 0,
+            blocks: Vec::new(),
+        }
+    }
+
+    pub fn n_blocks(&self) -> usize {
+        self.blocks.len()
+    }
+
+    pub fn block_size(&self) -> usize {
+        self.block_size
+    }
+
+    // Add one block of traces
+    pub fn update(
+        &mut self,
+        model: &dyn ConsumptionModelTrait,
+        payloads: &[[u8; 16]],
+        samples: &[Vec<f64>],
+    ) -> Result<(), Box<dyn Error>> {
+        // Steps of all the orderings must be the same number of traces
+        if self.blocks.is_empty() {
+            self.block_size = payloads.len();
+        } else if payloads.len() != self.block_size {
+            return Err(format!(
+                "Blocks must be {} traces long, got {}",
+                self.block_size,
+                payloads.len()
+            )
+            .into());
+        }
+
+        let mut block: Vec<BlockMoments> =
+            (0..16).map(|_| BlockMoments::new(self.duration)).collect();
+
+        // One thread per byte position
+        thread::scope(|scope| {
+            for (index, moments) in block.iter_mut().enumerate() {
+                scope.spawn(move || moments.update(model, payloads, samples, index));
+            }
+        });
+
+        self.blocks.push(block);
+        Ok(())
+    }
+
+    // Rank of each key byte after each block, for n_permutations random block
+    // orderings: n_permutations x n_blocks x 16, row-major
+    pub fn ranks(&self, key: &[u8; 16], n_permutations: usize, seed: Option<u64>) -> Vec<u16> {
+        let n_blocks = self.blocks.len();
+        let stride = n_blocks * 16;
+        let mut ranks = vec![0u16; n_permutations * stride];
+
+        // Orderings are drawn upfront, so that results don't depend on the
+        // number of threads
+        let mut rng = XorShift::new(seed);
+        let orderings: Vec<Vec<usize>> = (0..n_permutations)
+            .map(|_| {
+                let mut ordering: Vec<usize> = (0..n_blocks).collect();
+                rng.shuffle(&mut ordering);
+                ordering
+            })
+            .collect();
+
+        let n_threads = thread::available_parallelism()
+            .map(|n| n.get())
+            .unwrap_or(1);
+        let per_thread = (n_permutations + n_threads - 1) / n_threads.max(1);
+        if per_thread == 0 || stride == 0 {
+            return ranks;
+        }
+
+        thread::scope(|scope| {
+            for (ranks, orderings) in ranks
+                .chunks_mut(per_thread * stride)
+                .zip(orderings.chunks(per_thread))
+            {
+                scope.spawn(move || {
+                    let mut running = BlockMoments::new(self.duration);
+                    for (ranks, ordering) in ranks.chunks_mut(stride).zip(orderings) {
+                        for (j, k) in key.iter().enumerate() {
+                            running.reset();
+                            for (step, &b) in ordering.iter().enumerate() {
+                                running.merge(&self.blocks[b][j]);
+                                ranks[step * 16 + j] = running.rank(*k);
+                            }
+                        }
+                    }
+                });
+            }
+        });
+
+        ranks
+    }
+}
@@ -0,0 +1,350 @@
+use rusb::{Device, DeviceHandle, GlobalContext};
+use std::collections::hash_map::RandomState;
+use std::error::Error;
+use std::hash::{BuildHasher, Hasher};
+use std::sync::atomic::{AtomicBool, Ordering};
+use std::sync::{mpsc, Mutex};
+use std::thread;
+use std::time::{Duration, Instant};
+
+// Same protocol as esp_cpa_board.EspCpaBoard
+const VENDOR_ID: u16 = 0x04b4;
+const PRODUCT_ID: u16 = 0x8613;
+
+const CMD_ENDPOINT_OUT: u8 = 0x01;
+const CMD_ENDPOINT_IN: u8 = 0x81;
+const DATA_ENDPOINT_IN: u8 = 0x82;
+const CMD_PACKET_SIZE: usize = 64;
+const DATA_PACKET_SIZE: usize = 512;
+
+const CMD_TIMEOUT: Duration = Duration::from_secs(5);
+const DATA_TIMEOUT: Duration = Duration::from_secs(30);
+const DATA_POLL_TIMEOUT: Duration = Duration::from_millis(100);
+
+// Errors cross threads, the Python bindings release the GIL while capturing
+pub type CaptureResult<T> = Result<T, Box<dyn Error + Send + Sync>>;
+
+#[derive(Clone, Copy)]
+#[repr(u8)]
+enum CmdOpcode {
+    StartMeasurement = 1,
+    StopMeasurement = 2,
+    SetDac = 3,
+    SetDutPower = 4,
+    SetDutClkEn = 5,
+    SetFlashPayload = 6,
+    GetTemperature = 7,
+    SetHeaterPwm = 8,
+}
+
+#[derive(Default, Clone)]
+pub struct CaptureStats {
+    pub n_measurements: u64,
+    pub capture_ns: u64,
+}
+
+// Chunk of measurements, row-major
+pub struct CaptureChunk {
+    pub payloads: Vec<u8>, // (chunk_size, 16)
+    pub samples: Vec<i16>, // (chunk_size, averaging, n_samples)
+}
+
+// Payloads only need to be unpredictable for the DUT, not cryptographically
+// strong
+struct XorShift(u64);
+
+impl XorShift {
+    fn from_entropy() -> Self {
+        let mut hasher = RandomState::new().build_hasher();
+        hasher.write_u64(0);
+        XorShift(hasher.finish() | 1)
+    }
+
+    fn next(&mut self) -> u64 {
+        self.0 ^= self.0 << 13;
+        self.0 ^= self.0 >> 7;
+        self.0 ^= self.0 << 17;
+        self.0.wrapping_mul(0x2545f4914f6cdd1d)
+    }
+
+    fn payload(&mut self) -> [u8; 16] {
+        let mut payload = [0u8; 16];
+        payload[..8].copy_from_slice(&self.next().to_le_bytes());
+        payload[8..].copy_from_slice(&self.next().to_le_bytes());
+        payload
+    }
+}
+
+// Bus path, as in sysfs (bus-port.port...)
+fn bus_path(device: &Device<GlobalContext>) -> CaptureResult<String> {
+    let ports: Vec<String> = device
+        .port_numbers()?
+        .iter()
+        .map(|p| p.to_string())
+        .collect();
+    Ok(format!("{}-{}", device.bus_number(), ports.join(".")))
+}
+
+fn serial_number(device: &Device<GlobalContext>) -> Option<String> {
+    let descriptor = device.device_descriptor().ok()?;
+    let handle = device.open().ok()?;
+    handle.read_serial_number_string_ascii(&descriptor).ok()
+}
+
+fn boards() -> CaptureResult<Vec<Device<GlobalContext>>> {
+    let mut boards = Vec::new();
+    for device in rusb::devices()?.iter() {
+        let descriptor = device.device_descriptor()?;
+        if descriptor.vendor_id() == VENDOR_ID && descriptor.product_id() == PRODUCT_ID {
+            boards.push(device);
+        }
+    }
+    Ok(boards)
+}
+
+// (bus path, serial number) of each connected board
+pub fn list_boards() -> CaptureResult<Vec<(String, Option<String>)>> {
+    boards()?
+        .iter()
+        .map(|device| Ok((bus_path(device)?, serial_number(device))))
+        .collect()
+}
+
+// 12-bit two's complement samples, in 16-bit little endian words
+fn decode_samples(raw: &[u8], samples: &mut [i16]) {
+    for (sample, word) in samples.iter_mut().zip(raw.chunks_exact(2)) {
+        let value = u16::from_le_bytes([word[0], word[1]]) & 0x0fff;
+        *sample = ((value << 4) as i16) >> 4;
+    }
+}
+
+// Capture loop of one board, without any per-trace Python involvement
+pub struct CaptureEngine {
+    handle: DeviceHandle<GlobalContext>,
+    // Serializes the commands, so that the temperature can be monitored
+    // while capturing
+    cmd_lock: Mutex<()>,
+    rng: Mutex<XorShift>,
+    stats: Mutex<CaptureStats>,
+}
+
+impl CaptureEngine {
+    // Open the board with the given bus path or serial number, or the first
+    // board found
+    pub fn open(device: Option<&str>) -> CaptureResult<Self> {
+        let mut selected = None;
+        for board in boards()? {
+            let matches = match device {
+                None => true,
+                Some(name) => {
+                    bus_path(&board)? == name || serial_number(&board).as_deref() == Some(name)
+                }
+            };
+            if matches {
+                selected = Some(board);
+                break;
+            }
+        }
+        let Some(board) = selected else {
+            return Err("Device not found".into());
+        };
+
+        let mut handle = board.open()?;
+        // The usbtest kernel module may have claimed the board
+        let _ = handle.set_auto_detach_kernel_driver(true);
+        handle.claim_interface(0)?;
+
+        Ok(CaptureEngine {
+            handle,
+            cmd_lock: Mutex::new(()),
+            rng: Mutex::new(XorShift::from_entropy()),
+            stats: Mutex::new(CaptureStats::default()),
+        })
+    }
+
+    fn write_command(&self, opcode: CmdOpcode, arg: u32, data: &[u8]) -> CaptureResult<()> {
+        let mut payload = Vec::with_capacity(5 + data.len());
+        payload.push(opcode as u8);
+        payload.extend_from_slice(&arg.to_le_bytes());
+        payload.extend_from_slice(data);
+
+        // Endpoint is limited to 64 bytes
+        for packet in payload.chunks(CMD_PACKET_SIZE) {
+            self.handle
+                .write_bulk(CMD_ENDPOINT_OUT, packet, CMD_TIMEOUT)?;
+        }
+        Ok(())
+    }
+
+    fn read_reply(&self) -> CaptureResult<[u8; 2]> {
+        let mut reply = [0u8; 2];
+        let n = self
+            .handle
+            .read_bulk(CMD_ENDPOINT_IN, &mut reply, CMD_TIMEOUT)?;
+        if n != reply.len() {
+            return Err("Truncated command reply".into());
+        }
+        Ok(reply)
+    }
+
+    fn send_command(&self, opcode: CmdOpcode, arg: u32, data: &[u8]) -> CaptureResult<()> {
+        self.write_command(opcode, arg, data)?;
+        let reply = self.read_reply()?;
+        if reply != *b"O\x00" {
+            return Err(format!("Received invalid command reply: 0x{:02x}", reply[0]).into());
+        }
+        Ok(())
+    }
+
+    pub fn set_dut_power(&self, power: bool) -> CaptureResult<()> {
+        let _lock = self.cmd_lock.lock().unwrap();
+        self.send_command(CmdOpcode::SetDutPower, power as u32, &[])
+    }
+
+    pub fn set_clk_en(&self, en: bool) -> CaptureResult<()> {
+        let _lock = self.cmd_lock.lock().unwrap();
+        self.send_command(CmdOpcode::SetDutClkEn, en as u32, &[])
+    }
+
+    // Gain, expressed in percents
+    pub fn set_amplifier_gain(&self, gain: u32) -> CaptureResult<()> {
+        let target_voltage = gain as f64 * (1.1 - 0.1) / 100.0 + 0.1;
+        let vref = 1.21; // V
+        let dac_gain = 1.5;
+        let dac_count = (target_voltage * 1024.0 / (vref * dac_gain)).round() as u32;
+        let _lock = self.cmd_lock.lock().unwrap();
+        self.send_command(CmdOpcode::SetDac, dac_count, &[])
+    }
+
+    pub fn set_flash_payload(&self, payload: &[u8; 16]) -> CaptureResult<()> {
+        let _lock = self.cmd_lock.lock().unwrap();
+        self.send_command(CmdOpcode::SetFlashPayload, 0, payload)
+    }
+
+    // DUT temperature, expressed in °C
+    pub fn get_temperature(&self) -> CaptureResult<f64> {
+        let _lock = self.cmd_lock.lock().unwrap();
+        self.write_command(CmdOpcode::GetTemperature, 0, &[])?;
+        let reply = self.read_reply()?;
+        let code = ((reply[0] as u16) << 8) | reply[1] as u16;
+        Ok(-45.0 + 175.0 * code as f64 / 65535.0)
+    }
+
+    pub fn set_heater_pwm(&self, value: u32) -> CaptureResult<()> {
+        let _lock = self.cmd_lock.lock().unwrap();
+        self.send_command(CmdOpcode::SetHeaterPwm, value, &[])
+    }
+
+    // Measure n_measurements consecutive traces of n_samples samples each.
+    // The measurement is only started once the reader thread is about to
+    // submit its first transfer. That transfer is usually in flight before
+    // the board starts sending, otherwise the endpoint NAKs and the board FIFO
+    // holds the data until it is.
+    fn measure(&self, raw: &mut [u8]) -> CaptureResult<()> {
+        let handle = &self.handle;
+        let expected = raw.len();
+        let aborted = AtomicBool::new(false);
+        let (ready_tx, ready_rx) = mpsc::channel();
+        let received = thread::scope(|scope| -> CaptureResult<usize> {
+            let aborted = &aborted;
+            let reader = scope.spawn(move || {
+                let deadline = Instant::now() + DATA_TIMEOUT;
+                ready_tx.send(()).unwrap();
+                let mut received = 0;
+                while received < raw.len() {
+                    // Until the first packet, poll one packet at a time so that
+                    // a failed START stops the reader. A packet is received whole
+                    // or not at all, so polling loses no data.
+                    let (end, timeout) = if received == 0 {
+                        (raw.len().min(DATA_PACKET_SIZE), DATA_POLL_TIMEOUT)
+                    } else {
+                        (raw.len(), DATA_TIMEOUT)
+                    };
+                    match handle.read_bulk(DATA_ENDPOINT_IN, &mut raw[received..end], timeout) {
+                        Ok(0) => break,
+                        Ok(n) => received += n,
+                        Err(rusb::Error::Timeout)
+                            if received == 0
+                                && !aborted.load(Ordering::Relaxed)
+                                && Instant::now() < deadline => {}
+                        Err(e) => return Err(e),
+                    }
+                }
+                Ok(received)
+            });
+
+            ready_rx.recv().unwrap();
+            if let Err(e) = self.write_command(CmdOpcode::StartMeasurement, 0, &[]) {
+                aborted.store(true, Ordering::Relaxed);
+                let _ = reader.join();
+                return Err(e);
+            }
+            let received = reader.join().unwrap()?;
+
+            // Stop the measurement in a clean way
+            self.write_command(CmdOpcode::StopMeasurement, 0, &[])?;
+            Ok(received)
+        })?;
+
+        if received != expected {
+            return Err(format!("Received {} bytes out of {}", received, expected).into());
+        }
+        Ok(())
+    }
+
+    pub fn perform_measurement(
+        &self,
+        n_samples: usize,
+        n_measurements: usize,
+    ) -> CaptureResult<Vec<i16>> {
+        let mut raw = vec![0u8; n_measurements * n_samples * 2];
+        {
+            let _lock = self.cmd_lock.lock().unwrap();
+            self.measure(&mut raw)?;
+        }
+        let mut samples = vec![0i16; n_measurements * n_samples];
+        decode_samples(&raw, &mut samples);
+        Ok(samples)
+    }
+
+    // Capture chunk_size measurements with random payloads
+    pub fn capture_chunk(
+        &self,
+        chunk_size: usize,
+        averaging: usize,
+        n_samples: usize,
+    ) -> CaptureResult<CaptureChunk> {
+        let start = Instant::now();
+        let trace_len = averaging * n_samples;
+
+        let mut payloads = vec![0u8; chunk_size * 16];
+        let mut samples = vec![0i16; chunk_size * trace_len];
+        let mut raw = vec![0u8; trace_len * 2];
+
+        for (payload_row, samples_row) in payloads
+            .chunks_exact_mut(16)
+            .zip(samples.chunks_exact_mut(trace_len))
+        {
+            let payload = self.rng.lock().unwrap().payload();
+            payload_row.copy_from_slice(&payload);
+
+            // Commands of other threads may only come in between measurements
+            {
+                let _lock = self.cmd_lock.lock().unwrap();
+                self.send_command(CmdOpcode::SetFlashPayload, 0, &payload)?;
+                self.measure(&mut raw)?;
+            }
+            decode_samples(&raw, samples_row);
+        }
+
+        let mut stats = self.stats.lock().unwrap();
+        stats.n_measurements += chunk_size as u64;
+        stats.capture_ns += start.elapsed().as_nanos() as u64;
+
+        Ok(CaptureChunk { payloads, samples })
+    }
+
+    pub fn stats(&self) -> CaptureStats {
+        self.stats.lock().unwrap().clone()
+    }
+}
@@ -0,0 +1,177 @@
+use std::thread;
+
+const N_CLASSES: usize = 256;
+const N_BYTES: usize = 16;
+const N_PAIRS: usize = N_BYTES * (N_BYTES - 1) / 2;
+
+// In place Walsh-Hadamard transform, unnormalized
+fn walsh_hadamard(values: &mut [f64]) {
+    let mut h = 1;
+    while h < values.len() {
+        for block in values.chunks_exact_mut(2 * h) {
+            let (a, b) = block.split_at_mut(h);
+            for (x, y) in a.iter_mut().zip(b.iter_mut()) {
+                let (u, v) = (*x, *y);
+                *x = u + v;
+                *y = u - v;
+            }
+        }
+        h *= 2;
+    }
+}
+
+// Correlation-enhanced collision attack. Mean traces are accumulated for each
+// value of each plaintext byte. When two S-box inputs collide,
+// p_i ^ k_i == p_j ^ k_j, the class means of byte i for value v match the ones
+// of byte j for value v ^ delta, with delta = k_i ^ k_j. No leakage model is
+// needed.
+pub struct CollisionEngine {
+    duration: usize,
+    counts: Vec<u64>, // N_BYTES x N_CLASSES
+    sums: Vec<f64>,   // N_BYTES x N_CLASSES x duration
+}
+
+impl CollisionEngine {
+    pub fn new(duration: usize) -> Self {
+        CollisionEngine {
+            duration,
+            counts: vec![0; N_BYTES * N_CLASSES],
+            sums: vec![0.0; N_BYTES * N_CLASSES * duration],
+        }
+    }
+
+    pub fn update(&mut self, payloads: &[[u8; 16]], samples: &[Vec<f64>]) {
+        let duration = self.duration;
+
+        // One thread per byte position
+        thread::scope(|scope| {
+            for (index, (counts, sums)) in self
+                .counts
+                .chunks_exact_mut(N_CLASSES)
+                .zip(self.sums.chunks_exact_mut(N_CLASSES * duration))
+                .enumerate()
+            {
+                scope.spawn(move || {
+                    for (p, x) in payloads.iter().zip(samples.iter()) {
+                        let c = p[index] as usize;
+                        counts[c] += 1;
+                        for (s, v) in sums[c * duration..(c + 1) * duration]
+                            .iter_mut()
+                            .zip(x.iter())
+                        {
+                            *s += v;
+                        }
+                    }
+                });
+            }
+        });
+    }
+
+    // Walsh-Hadamard transforms of the class means of one byte, one per
+    // sample. Class means are centered and scaled to unit norm over the
+    // classes, so that their products sum to correlation coefficients.
+    fn class_mean_spectra(&self, index: usize) -> Vec<Vec<f64>> {
+        let counts = &self.counts[index * N_CLASSES..(index + 1) * N_CLASSES];
+        let sums =
+            &self.sums[index * N_CLASSES * self.duration..(index + 1) * N_CLASSES * self.duration];
+
+        (0..self.duration)
+            .map(|t| {
+                let mut means: Vec<f64> = counts
+                    .iter()
+                    .enumerate()
+                    .map(|(c, &n)| {
+                        if n > 0 {
+                            sums[c * self.duration + t] / n as f64
+                        } else {
+                            f64::NAN
+                        }
+                    })
+                    .collect();
+
+                // Classes not seen yet don't contribute
+                let seen: Vec<f64> = means.iter().copied().filter(|m| !m.is_nan()).collect();
+                let mean = if seen.is_empty() {
+                    0.0
+                } else {
+                    seen.iter().sum::<f64>() / seen.len() as f64
+                };
+                for m in means.iter_mut() {
+                    *m = if m.is_nan() { 0.0 } else { *m - mean };
+                }
+                let norm = means.iter().map(|m| m * m).sum::<f64>().sqrt();
+                if norm > 0.0 {
+                    for m in means.iter_mut() {
+                        *m /= norm;
+                    }
+                }
+
+                walsh_hadamard(&mut means);
+                means
+            })
+            .collect()
+    }
+
+    // Collision score of each delta, for each pair of bytes:
+    // N_BYTES x N_BYTES x N_CLASSES, row-major, zero on the diagonal. The
+    // score is the highest absolute correlation over all the sample pairs.
+    pub fn get_result(&self) -> Vec<f64> {
+        let spectra: Vec<Vec<Vec<f64>>> =
+            (0..N_BYTES).map(|i| self.class_mean_spectra(i)).collect();
+
+        let pairs: Vec<(usize, usize)> = (0..N_BYTES)
+            .flat_map(|i| (i + 1..N_BYTES).map(move |j| (i, j)))
+            .collect();
+
+        let n_threads = thread::available_parallelism()
+            .map(|n| n.get())
+            .unwrap_or(1);
+        let per_thread = (N_PAIRS + n_threads - 1) / n_threads;
+
+        // XOR cross-correlation of the class means over all the deltas at once:
+        // sum_v a[v] b[v ^ delta] = WHT(WHT(a) * WHT(b))[delta] / N_CLASSES
+        let pair_scores: Vec<Vec<f64>> = thread::scope(|scope| {
+            let handles: Vec<_> = pairs
+                .chunks(per_thread)
+                .map(|pairs| {
+                    let spectra = &spectra;
+                    scope.spawn(move || {
+                        pairs
+                            .iter()
+                            .map(|&(i, j)| {
+                                let mut scores = vec![0.0f64; N_CLASSES];
+                                let mut product = vec![0.0f64; N_CLASSES];
+                                for a in spectra[i].iter() {
+                                    for b in spectra[j].iter() {
+                                        for ((p, x), y) in product.iter_mut().zip(a).zip(b) {
+                                            *p = x * y;
+                                        }
+                                        walsh_hadamard(&mut product);
+                                        for (s, p) in scores.iter_mut().zip(product.iter()) {
+                                            *s = s.max((p / N_CLASSES as f64).abs());
+                                        }
+                                    }
+                                }
+                                scores
+                            })
+                            .collect::<Vec<_>>()
+                    })
+                })
+                .collect();
+            handles
+                .into_iter()
+                .flat_map(|h| h.join().unwrap())
+                .collect()
+        });
+
+        // delta is symmetric, both halves hold the same scores
+        let mut result = vec![0.0f64; N_BYTES * N_BYTES * N_CLASSES];
+        for (&(i, j), scores) in pairs.iter().zip(pair_scores.iter()) {
+            for (a, b) in [(i, j), (j, i)] {
+                let offset = (a * N_BYTES + b) * N_CLASSES;
+                result[offset..offset + N_CLASSES].copy_from_slice(scores);
+            }
+        }
+        result
+    }
+}
@@ -17,6 +17,38 @@ void pearson_step(double *mx, double *my,
     *my = my2;
 }
 
+void update_correlation(__global double *x, __global double *y,
+                        __global double *result,
+                        __global double *mx, __global double *my,
+                        __global double *MX, __global double *MY,
+                        __global double *C,
+                        unsigned int n_samples,
+                        unsigned int last_n)
+{
+    size_t index = get_global_id(0) * get_global_size(1) + get_global_id(1);
+
+    double _mx = mx[index];
+    double _my = my[index];
+    double _MX = MX[index];
+    double _MY = MY[index];
+    double _C = C[index];
+
+    for (int i = 0; i < n_samples; i++)
+    {
+        pearson_step(&_mx, &_my, &_MX, &_MY, &_C, x[i], y[i], last_n + i);
+    }
+
+    mx[index] = _mx;
+    my[index] = _my;
+
+    MX[index] = _MX;
+    MY[index] = _MY;
+
+    C[index] = _C;
+
+    result[index] = _C / (sqrt(_MX) * sqrt(_MY));
+}
+
 __kernel void compute_correlations(__global double *samples, __global double *guesses,
                                    __global double *result,
                                    __global double *mx, __global double *my,
@@ -28,24 +60,24 @@ __kernel void compute_correlations(__global double *samples, __global double *gu
     __global double *x = &samples[get_global_id(1) * n_samples];
     __global double *y = &guesses[get_global_id(0) * n_samples];
 
-    double _mx = mx[get_global_id(0) * get_global_size(1) + get_global_id(1)];
-    double _my = my[get_global_id(0) * get_global_size(1) + get_global_id(1)];
-    double _MX = MX[get_global_id(0) * get_global_size(1) + get_global_id(1)];
-    double _MY = MY[get_global_id(0) * get_global_size(1) + get_global_id(1)];
-    double _C = C[get_global_id(0) * get_global_size(1) + get_global_id(1)];
-
-    for (int i = 0; i < n_samples; i++)
-    {
-        pearson_step(&_mx, &_my, &_MX, &_MY, &_C, x[i], y[i], last_n + i);
-    }
-
-    mx[get_global_id(0) * get_global_size(1) + get_global_id(1)] = _mx;
-    my[get_global_id(0) * get_global_size(1) + get_global_id(1)] = _my;
+    update_correlation(x, y, result, mx, my, MX, MY, C, n_samples, last_n);
+}
 
-    MX[get_global_id(0) * get_global_size(1) + get_global_id(1)] = _MX;
-    MY[get_global_id(0) * get_global_size(1) + get_global_id(1)] = _MY;
+// Each sample (POI) belongs to a group, e.g. a key byte, with its own set of
+// guesses: guesses are stored group after group
+__kernel void compute_grouped_correlations(__global double *samples, __global double *guesses,
+                                           __global double *result,
+                                           __global double *mx, __global double *my,
+                                           __global double *MX, __global double *MY,
+                                           __global double *C,
+                                           __global unsigned int *groups,
+                                           unsigned int n_samples,
+                                           unsigned int last_n)
+{
+    size_t row = groups[get_global_id(1)] * get_global_size(0) + get_global_id(0);
 
-    C[get_global_id(0) * get_global_size(1) + get_global_id(1)] = _C;
+    __global double *x = &samples[get_global_id(1) * n_samples];
+    __global double *y = &guesses[row * n_samples];
 
-    result[get_global_id(0) * get_global_size(1) + get_global_id(1)] = _C / (sqrt(_MX) * sqrt(_MY));
-}
\ No newline at end of file
+    update_correlation(x, y, result, mx, my, MX, MY, C, n_samples, last_n);
+}
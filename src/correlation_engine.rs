@@ -1,5 +1,24 @@
-use ocl::{Buffer, MemFlags, ProQue};
+use ocl::enums::ProfilingInfo;
+use ocl::flags::CommandQueueProperties;
+use ocl::{Buffer, Event, MemFlags, ProQue, Queue};
+use std::cell::RefCell;
 use std::error::Error;
+use std::time::Instant;
+
+use super::opencl_context::{get_program, DeviceSelection};
+
+// Cumulative timings, in nanoseconds.
+// Device timings are only recorded when profiling is enabled.
+#[derive(Default, Clone)]
+pub struct EngineStats {
+    pub n_updates: u64,
+    pub n_traces: u64,
+    pub flatten_ns: u64,
+    pub buffer_creation_ns: u64,
+    pub host_to_device_ns: u64,
+    pub kernel_ns: u64,
+    pub readback_ns: u64,
+}
 
 pub struct OpenclCorrelationEngine {
     pro_queue: ProQue,
@@ -7,17 +26,89 @@ pub struct OpenclCorrelationEngine {
     result_buffer: Buffer<f64>,
     last_n: usize,
     sample_duration: usize,
-    n_guesses: usize
+    n_guesses: usize,
+    n_groups: usize,
+    _groups_buffer: Option<Buffer<u32>>,
+    profiling: bool,
+    stats: RefCell<EngineStats>,
+}
+
+fn elapsed_ns(start: Instant) -> u64 {
+    start.elapsed().as_nanos() as u64
+}
+
+// Execution time of a profiled command
+fn event_duration_ns(event: &Event) -> Result<u64, Box<dyn Error>> {
+    event.wait_for()?;
+    let start = event.profiling_info(ProfilingInfo::Start)?.time()?;
+    let end = event.profiling_info(ProfilingInfo::End)?.time()?;
+    Ok(end.saturating_sub(start))
 }
 
 impl OpenclCorrelationEngine {
     pub fn new(sample_duration: usize, n_guesses: usize) -> Result<Self, Box<dyn Error>> {
+        Self::with_options(sample_duration, n_guesses, false, &DeviceSelection::default())
+    }
+
+    // When profiling is enabled, each command is waited for to read its event
+    // timestamps, so that host and device work don't overlap anymore
+    pub fn with_profiling(
+        sample_duration: usize,
+        n_guesses: usize,
+        profiling: bool,
+    ) -> Result<Self, Box<dyn Error>> {
+        Self::with_options(
+            sample_duration,
+            n_guesses,
+            profiling,
+            &DeviceSelection::default(),
+        )
+    }
+
+    pub fn with_options(
+        sample_duration: usize,
+        n_guesses: usize,
+        profiling: bool,
+        selection: &DeviceSelection,
+    ) -> Result<Self, Box<dyn Error>> {
+        Self::with_groups(sample_duration, n_guesses, profiling, selection, None)
+    }
+
+    // With groups, each sample is only correlated with the n_guesses guesses of
+    // its group (groups[sample]), and update() takes the guesses of all the
+    // groups, group after group. This is how several key bytes, each with its
+    // own POIs, share a single kernel run.
+    pub fn with_groups(
+        sample_duration: usize,
+        n_guesses: usize,
+        profiling: bool,
+        selection: &DeviceSelection,
+        groups: Option<&[u32]>,
+    ) -> Result<Self, Box<dyn Error>> {
+        if let Some(groups) = groups {
+            if groups.len() != sample_duration {
+                return Err("One group per sample is expected".into());
+            }
+        }
+
         let src = include_str!("correlation.cl");
 
-        let pro_queue = ProQue::builder()
-            .src(src)
-            .dims((n_guesses, sample_duration))
-            .build()?;
+        // The context and program are shared by all the engines of the process
+        let shared = get_program(selection, src)?;
+
+        let properties = if profiling {
+            Some(CommandQueueProperties::new().profiling())
+        } else {
+            None
+        };
+        let queue = Queue::new(&shared.context, shared.device, properties)?;
+
+        let pro_queue = ProQue::new(
+            shared.context,
+            queue,
+            shared.program,
+            Some((n_guesses, sample_duration)),
+        );
 
         //
         // Allocate result and state buffers
@@ -34,8 +125,27 @@ impl OpenclCorrelationEngine {
         // Build kernel
         //
 
-        let kernel = pro_queue
-            .kernel_builder("compute_correlations")
+        // Group of each sample, and number of groups
+        let groups_buffer = match groups {
+            Some(groups) => Some(
+                Buffer::<u32>::builder()
+                    .queue(pro_queue.queue().clone())
+                    .flags(MemFlags::new().read_only())
+                    .len(groups.len())
+                    .copy_host_slice(groups)
+                    .build()?,
+            ),
+            None => None,
+        };
+        let n_groups = groups
+            .and_then(|g| g.iter().max())
+            .map_or(1, |g| *g as usize + 1);
+
+        let mut builder = pro_queue.kernel_builder(match groups {
+            Some(_) => "compute_grouped_correlations",
+            None => "compute_correlations",
+        });
+        builder
             .arg_named("samples", None::<&Buffer<f64>>)
             .arg_named("guesses", None::<&Buffer<f64>>)
             .arg(&result_buffer)
@@ -43,7 +153,11 @@ impl OpenclCorrelationEngine {
             .arg(&my_buffer)
             .arg(&mmx_buffer)
             .arg(&mmy_buffer)
-            .arg(&c_buffer)
+            .arg(&c_buffer);
+        if let Some(groups_buffer) = groups_buffer.as_ref() {
+            builder.arg(groups_buffer);
+        }
+        let kernel = builder
             .arg_named("n_samples", 0_u32)
             .arg_named("last_n", 0_u32)
             .build()?;
@@ -54,7 +168,11 @@ impl OpenclCorrelationEngine {
             result_buffer,
             last_n: 0,
             sample_duration,
-            n_guesses
+            n_guesses,
+            n_groups,
+            _groups_buffer: groups_buffer,
+            profiling,
+            stats: RefCell::new(EngineStats::default()),
         };
 
         Ok(ret)
@@ -65,46 +183,62 @@ impl OpenclCorrelationEngine {
         samples: Vec<Vec<f64>>,
         guesses: Vec<Vec<f64>>,
     ) -> Result<(), Box<dyn Error>> {
-        //
-        // Generate samples buffer
-        //
+        let mut stats = self.stats.borrow_mut();
 
         let n_samples = samples[0].len();
 
-        // Flatten buffer
+        // Flatten buffers
+        let start = Instant::now();
         let samples_vec: Vec<f64> = samples.into_iter().flatten().collect();
+        let guesses: Vec<f64> = guesses.into_iter().flatten().collect();
+        stats.flatten_ns += elapsed_ns(start);
+
+        //
+        // Generate samples and guesses buffers
+        //
 
-        let samples_buffer = Buffer::builder()
+        let start = Instant::now();
+        let samples_buffer = Buffer::<f64>::builder()
             .queue(self.pro_queue.queue().clone())
             .flags(MemFlags::new().read_only())
             .len((self.sample_duration, n_samples))
-            .copy_host_slice(&samples_vec)
             .build()?;
-
-        self.kernel.set_arg("samples", samples_buffer)?;
-        self.kernel.set_arg("n_samples", n_samples as u32)?;
-
-        //
-        // Generate guesses buffer
-        //
-
-        // Flatten vector
-        let guesses: Vec<f64> = guesses.into_iter().flatten().collect();
-
-        let guesses_buffer = Buffer::builder()
+        let guesses_buffer = Buffer::<f64>::builder()
             .queue(self.pro_queue.queue().clone())
             .flags(MemFlags::new().read_only())
-            .len((self.n_guesses, n_samples))
-            .copy_host_slice(&guesses)
+            .len((self.n_groups * self.n_guesses, n_samples))
             .build()?;
+        stats.buffer_creation_ns += elapsed_ns(start);
 
+        let mut samples_event = Event::empty();
+        let mut guesses_event = Event::empty();
+        samples_buffer
+            .write(&samples_vec)
+            .enew(&mut samples_event)
+            .enq()?;
+        guesses_buffer
+            .write(&guesses)
+            .enew(&mut guesses_event)
+            .enq()?;
+
+        self.kernel.set_arg("samples", samples_buffer)?;
+        self.kernel.set_arg("n_samples", n_samples as u32)?;
         self.kernel.set_arg("guesses", guesses_buffer)?;
 
         self.kernel.set_arg("last_n", self.last_n as u32)?;
         self.last_n += n_samples;
 
+        let mut kernel_event = Event::empty();
         unsafe {
-            self.kernel.enq()?;
+            self.kernel.cmd().enew(&mut kernel_event).enq()?;
+        }
+
+        stats.n_updates += 1;
+        stats.n_traces += n_samples as u64;
+        if self.profiling {
+            stats.host_to_device_ns +=
+                event_duration_ns(&samples_event)? + event_duration_ns(&guesses_event)?;
+            stats.kernel_ns += event_duration_ns(&kernel_event)?;
         }
 
         Ok(())
@@ -112,7 +246,11 @@ impl OpenclCorrelationEngine {
 
     pub fn get_result(&self) -> Result<Vec<Vec<f64>>, Box<dyn Error>> {
         let mut result = vec![0.0f64; self.result_buffer.len()];
-        self.result_buffer.read(&mut result).enq()?;
+        let mut event = Event::empty();
+        self.result_buffer.read(&mut result).enew(&mut event).enq()?;
+        if self.profiling {
+            self.stats.borrow_mut().readback_ns += event_duration_ns(&event)?;
+        }
 
         let result: Vec<Vec<f64>> = result
             .chunks(self.sample_duration)
@@ -121,4 +259,8 @@ impl OpenclCorrelationEngine {
 
         Ok(result)
     }
+
+    pub fn stats(&self) -> EngineStats {
+        self.stats.borrow().clone()
+    }
 }
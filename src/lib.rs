@@ -1,26 +1,57 @@
-use numpy::{PyArray2, PyReadonlyArray2};
+use numpy::{PyArray1, PyArray2, PyArray3, PyReadonlyArray1, PyReadonlyArray2};
 use pyo3::{
     exceptions::PyTypeError,
     prelude::*,
     types::{PyBytes, PyDict},
 };
+use std::collections::HashMap;
+use std::time::Instant;
 
-mod aes;
-mod correlation_engine;
-mod power_consumption_models;
+pub mod aes;
+mod alignment;
+mod bootstrap;
+mod collision;
+#[cfg(feature = "capture")]
+mod capture;
+pub mod correlation_engine;
+mod linalg;
+mod mia;
+pub mod opencl_context;
+pub mod power_consumption_models;
+mod regression;
+pub mod sample_codec;
+mod sharded_engine;
+mod snr;
+mod template;
 
-use correlation_engine::OpenclCorrelationEngine;
+use alignment::AlignmentEngine;
+use bootstrap::BootstrapEngine;
+use collision::CollisionEngine;
+#[cfg(feature = "capture")]
+use capture::{list_boards, CaptureEngine};
+use correlation_engine::EngineStats;
+use opencl_context::{list_devices, DeviceSelection};
 use power_consumption_models::{
     state_hamming_weight, ConsumptionModelRound0, ConsumptionModelRound0DecTable,
     ConsumptionModelRound1, ConsumptionModelRound1DecTable, ConsumptionModelTrait,
 };
+use mia::MiaEngine;
+use regression::LinearRegressionEngine;
+use sharded_engine::ShardedCorrelationEngine;
+use snr::SnrEngine;
+use template::{Projection, TemplateAttackEngine, TemplateProfilingEngine, Templates};
 
 #[pyclass]
 struct CpaSolver {
     // Ciphertext inputs
-    correlation_engine: Option<OpenclCorrelationEngine>,
+    correlation_engine: Option<ShardedCorrelationEngine>,
     power_consumption_model: Box<dyn ConsumptionModelTrait>,
     k_index: usize,
+    profiling: bool,
+    selection: DeviceSelection,
+    // Host side timings, in nanoseconds
+    hypotheses_ns: u64,
+    transpose_ns: u64,
 }
 
 fn get_power_consumption_model(
@@ -98,14 +129,128 @@ fn get_power_consumption_model(
     }
 }
 
+// Shared by the CPA solvers
+
+fn build_correlation_engine(
+    duration: usize,
+    n_guesses: usize,
+    profiling: bool,
+    selection: &DeviceSelection,
+    groups: Option<&[u32]>,
+) -> PyResult<ShardedCorrelationEngine> {
+    match selection.expand().and_then(|selections| {
+        ShardedCorrelationEngine::with_groups(duration, n_guesses, profiling, &selections, groups)
+    }) {
+        Ok(engine) => Ok(engine),
+        Err(e) => {
+            let msg = format!("Cannot build correlation engine: {:?}", e);
+            Err(PyErr::new::<PyTypeError, _>(msg))
+        }
+    }
+}
+
+fn update_correlation_engine(
+    correlation_engine: &mut ShardedCorrelationEngine,
+    samples: Vec<Vec<f64>>,
+    guesses: Vec<Vec<f64>>,
+) -> PyResult<()> {
+    match correlation_engine.update(samples, guesses) {
+        Ok(_) => Ok(()),
+        Err(e) => {
+            let msg = format!("Cannot update correlation engine: {:?}", e);
+            Err(PyErr::new::<PyTypeError, _>(msg))
+        }
+    }
+}
+
+fn correlation_result(
+    correlation_engine: Option<&ShardedCorrelationEngine>,
+) -> PyResult<Py<PyArray2<f64>>> {
+    let Some(correlation_engine) = correlation_engine else {
+        return Err(PyErr::new::<PyTypeError, _>("No results"));
+    };
+    let result = match correlation_engine.get_result() {
+        Ok(result) => result,
+        Err(e) => {
+            let msg = format!("Cannot get correlation results: {:?}", e);
+            return Err(PyErr::new::<PyTypeError, _>(msg));
+        }
+    };
+
+    let ret = Python::with_gil(|py| -> Py<PyArray2<f64>> {
+        PyArray2::from_vec2(py, &result).unwrap().to_owned()
+    });
+
+    Ok(ret)
+}
+
+// Cumulative counters. Timings are in seconds, device ones are only available
+// when profiling is enabled.
+fn correlation_stats(
+    correlation_engine: Option<&ShardedCorrelationEngine>,
+    hypotheses_ns: u64,
+    transpose_ns: u64,
+    profiling: bool,
+) -> HashMap<&'static str, f64> {
+    let engine_stats = match correlation_engine {
+        Some(engine) => engine.stats(),
+        None => EngineStats::default(),
+    };
+
+    let mut stats = HashMap::new();
+    stats.insert("n_updates", engine_stats.n_updates as f64);
+    stats.insert("n_traces", engine_stats.n_traces as f64);
+    stats.insert("hypotheses", hypotheses_ns as f64 * 1e-9);
+    stats.insert("transpose", transpose_ns as f64 * 1e-9);
+    stats.insert("flatten", engine_stats.flatten_ns as f64 * 1e-9);
+    stats.insert(
+        "buffer_creation",
+        engine_stats.buffer_creation_ns as f64 * 1e-9,
+    );
+    if profiling {
+        stats.insert(
+            "host_to_device",
+            engine_stats.host_to_device_ns as f64 * 1e-9,
+        );
+        stats.insert("kernel", engine_stats.kernel_ns as f64 * 1e-9);
+        stats.insert("readback", engine_stats.readback_ns as f64 * 1e-9);
+    }
+    stats
+}
+
+// Guesses of all possible bytes for each model, model after model
+fn estimate_guesses(
+    power_consumption_models: &[Box<dyn ConsumptionModelTrait>],
+    payloads: &[[u8; 16]],
+    k_index: usize,
+) -> Vec<Vec<f64>> {
+    let n_guesses = power_consumption_models.len() * 256;
+    let mut guesses: Vec<Vec<f64>> = vec![Vec::with_capacity(payloads.len()); n_guesses];
+    for (n, model) in power_consumption_models.iter().enumerate() {
+        for c in payloads.iter() {
+            let estimates = model.estimate_all(c, k_index);
+            for (i, e) in estimates.into_iter().enumerate() {
+                guesses[n * 256 + i].push(e);
+            }
+        }
+    }
+    guesses
+}
+
 #[pymethods]
 impl CpaSolver {
     #[new]
+    #[pyo3(signature = (
+        name, k_index, beta_modifier, py_kwargs=None, profiling=false, platform=None, device=None
+    ))]
     fn new(
         name: &str,
         k_index: usize,
         beta_modifier: f64,
         py_kwargs: Option<&PyDict>,
+        profiling: bool,
+        platform: Option<usize>,
+        device: Option<usize>,
     ) -> PyResult<Self> {
         let power_consumption_model = get_power_consumption_model(name, py_kwargs, beta_modifier)?;
 
@@ -113,6 +258,10 @@ impl CpaSolver {
             correlation_engine: None,
             power_consumption_model,
             k_index,
+            profiling,
+            selection: DeviceSelection { platform, device },
+            hypotheses_ns: 0,
+            transpose_ns: 0,
         };
         Ok(ret)
     }
@@ -125,17 +274,17 @@ impl CpaSolver {
         // Instantiate a correlation engine if needed
         if self.correlation_engine.is_none() {
             let duration = py_samples.shape()[1];
-            let correlation_engine = match OpenclCorrelationEngine::new(duration, 256) {
-                Ok(engine) => engine,
-                Err(e) => {
-                    let msg = format!("Cannot build correlation engine: {:?}", e);
-                    return Err(PyErr::new::<PyTypeError, _>(msg));
-                }
-            };
-            self.correlation_engine = Some(correlation_engine);
+            self.correlation_engine = Some(build_correlation_engine(
+                duration,
+                256,
+                self.profiling,
+                &self.selection,
+                None,
+            )?);
         }
 
         // Generated guesses for all possible bytes
+        let start = Instant::now();
         let guesses: Vec<Vec<f64>> = (0..=u8::MAX)
             .map(|i| {
                 payloads
@@ -144,38 +293,649 @@ impl CpaSolver {
                     .collect()
             })
             .collect();
+        self.hypotheses_ns += start.elapsed().as_nanos() as u64;
+
+        let start = Instant::now();
+        let samples = array_to_columns(py_samples);
+        self.transpose_ns += start.elapsed().as_nanos() as u64;
+
+        update_correlation_engine(self.correlation_engine.as_mut().unwrap(), samples, guesses)
+    }
 
-        let mut samples: Vec<Vec<f64>> = Vec::new();
-        let py_samples = py_samples.as_array();
+    // See correlation_stats()
+    fn stats(&self) -> HashMap<&'static str, f64> {
+        correlation_stats(
+            self.correlation_engine.as_ref(),
+            self.hypotheses_ns,
+            self.transpose_ns,
+            self.profiling,
+        )
+    }
 
-        for column in py_samples.columns() {
-            let v = column.to_vec();
-            samples.push(v);
+    fn get_result(&self) -> PyResult<Py<PyArray2<f64>>> {
+        correlation_result(self.correlation_engine.as_ref())
+    }
+}
+
+// CPA of the 16 key bytes at once, each byte with its own window of samples.
+// Windows are packed contiguously in the samples, byte after byte, and each
+// sample is only correlated with the guesses of its byte: the work grows with
+// the total number of POIs rather than 16 times their union.
+#[pyclass]
+struct WindowedCpaSolver {
+    correlation_engine: Option<ShardedCorrelationEngine>,
+    power_consumption_model: Box<dyn ConsumptionModelTrait>,
+    groups: Vec<u32>,
+    profiling: bool,
+    selection: DeviceSelection,
+    // Host side timings, in nanoseconds
+    hypotheses_ns: u64,
+    transpose_ns: u64,
+}
+
+#[pymethods]
+impl WindowedCpaSolver {
+    #[new]
+    #[pyo3(signature = (
+        name, beta_modifier, windows, py_kwargs=None, profiling=false, platform=None, device=None
+    ))]
+    fn new(
+        name: &str,
+        beta_modifier: f64,
+        windows: Vec<usize>,
+        py_kwargs: Option<&PyDict>,
+        profiling: bool,
+        platform: Option<usize>,
+        device: Option<usize>,
+    ) -> PyResult<Self> {
+        // Every group must be present for the guesses of update() to match
+        if windows.len() != 16 || windows.iter().any(|&n| n == 0) {
+            return Err(PyErr::new::<PyTypeError, _>(
+                "One non-empty window per key byte is expected",
+            ));
         }
+        let power_consumption_model = get_power_consumption_model(name, py_kwargs, beta_modifier)?;
 
-        let correlation_engine = self.correlation_engine.as_mut().unwrap();
-        match correlation_engine.update(samples, guesses) {
-            Ok(_) => Ok(()),
-            Err(e) => {
-                let msg = format!("Cannot update correlation engine: {:?}", e);
-                Err(PyErr::new::<PyTypeError, _>(msg))
-            }
+        // Key byte of each packed sample
+        let groups: Vec<u32> = windows
+            .iter()
+            .enumerate()
+            .flat_map(|(k, &n)| std::iter::repeat(k as u32).take(n))
+            .collect();
+
+        let ret = WindowedCpaSolver {
+            correlation_engine: None,
+            power_consumption_model,
+            groups,
+            profiling,
+            selection: DeviceSelection { platform, device },
+            hypotheses_ns: 0,
+            transpose_ns: 0,
+        };
+        Ok(ret)
+    }
+
+    fn update(
+        &mut self,
+        payloads: Vec<[u8; 16]>,
+        py_samples: PyReadonlyArray2<f64>,
+    ) -> PyResult<()> {
+        if py_samples.shape()[1] != self.groups.len() {
+            let msg = format!("{} samples per trace are expected", self.groups.len());
+            return Err(PyErr::new::<PyTypeError, _>(msg));
+        }
+
+        // Instantiate a correlation engine if needed
+        if self.correlation_engine.is_none() {
+            self.correlation_engine = Some(build_correlation_engine(
+                self.groups.len(),
+                256,
+                self.profiling,
+                &self.selection,
+                Some(self.groups.as_slice()),
+            )?);
+        }
+
+        // Generated guesses for all possible bytes, byte after byte
+        let start = Instant::now();
+        let guesses: Vec<Vec<f64>> = (0..16)
+            .flat_map(|k| (0..=u8::MAX).map(move |i| (k, i)))
+            .map(|(k, i)| {
+                payloads
+                    .iter()
+                    .map(|c| self.power_consumption_model.estimate(c, i, k))
+                    .collect()
+            })
+            .collect();
+        self.hypotheses_ns += start.elapsed().as_nanos() as u64;
+
+        let start = Instant::now();
+        let samples = array_to_columns(py_samples);
+        self.transpose_ns += start.elapsed().as_nanos() as u64;
+
+        update_correlation_engine(self.correlation_engine.as_mut().unwrap(), samples, guesses)
+    }
+
+    // See correlation_stats()
+    fn stats(&self) -> HashMap<&'static str, f64> {
+        correlation_stats(
+            self.correlation_engine.as_ref(),
+            self.hypotheses_ns,
+            self.transpose_ns,
+            self.profiling,
+        )
+    }
+
+    // Correlations shaped (256, total number of samples): the columns of each
+    // window hold the correlations with the guesses of its key byte
+    fn get_result(&self) -> PyResult<Py<PyArray2<f64>>> {
+        correlation_result(self.correlation_engine.as_ref())
+    }
+}
+
+#[pyclass]
+struct FanoutCpaSolver {
+    correlation_engine: Option<ShardedCorrelationEngine>,
+    // One power consumption model per combination of round 0 key candidates
+    power_consumption_models: Vec<Box<dyn ConsumptionModelTrait>>,
+    combinations: Vec<[u8; 16]>,
+    key_dependencies: Vec<usize>,
+    k_index: usize,
+}
+
+#[pymethods]
+impl FanoutCpaSolver {
+    #[new]
+    fn new(
+        name: &str,
+        k_index: usize,
+        beta_modifier: f64,
+        candidates: Vec<Vec<u8>>,
+    ) -> PyResult<Self> {
+        if candidates.len() != 16 || candidates.iter().any(|c| c.is_empty()) {
+            return Err(PyErr::new::<PyTypeError, _>(
+                "At least one candidate must be provided for each of the 16 bytes",
+            ));
+        }
+
+        let key_dependencies = if name == "round1" {
+            ConsumptionModelRound1::key_dependencies(k_index)
+        } else if name == "round1dectable" {
+            ConsumptionModelRound1DecTable::key_dependencies(k_index)
+        } else {
+            return Err(PyErr::new::<PyTypeError, _>("Unknown model name"));
+        };
+
+        // Bytes the model does not depend on are set to their best candidate
+        let mut base_key = [0u8; 16];
+        for (k, c) in base_key.iter_mut().zip(candidates.iter()) {
+            *k = c[0];
+        }
+
+        // Cartesian product of the candidates of the bytes the model depends on
+        let mut combinations = vec![base_key];
+        for &i in key_dependencies.iter() {
+            combinations = combinations
+                .iter()
+                .flat_map(|key| {
+                    candidates[i].iter().map(move |&c| {
+                        let mut key = *key;
+                        key[i] = c;
+                        key
+                    })
+                })
+                .collect();
+        }
+
+        let power_consumption_models = combinations
+            .iter()
+            .map(|key| -> Box<dyn ConsumptionModelTrait> {
+                if name == "round1" {
+                    Box::new(ConsumptionModelRound1::new(key, beta_modifier))
+                } else {
+                    Box::new(ConsumptionModelRound1DecTable::new(key, beta_modifier))
+                }
+            })
+            .collect();
+
+        let ret = FanoutCpaSolver {
+            correlation_engine: None,
+            power_consumption_models,
+            combinations,
+            key_dependencies,
+            k_index,
+        };
+        Ok(ret)
+    }
+
+    fn get_combinations(&self) -> Vec<Vec<u8>> {
+        self.combinations.iter().map(|key| key.to_vec()).collect()
+    }
+
+    fn get_key_dependencies(&self) -> Vec<usize> {
+        self.key_dependencies.clone()
+    }
+
+    fn update(
+        &mut self,
+        payloads: Vec<[u8; 16]>,
+        py_samples: PyReadonlyArray2<f64>,
+    ) -> PyResult<()> {
+        // Instantiate a correlation engine if needed
+        if self.correlation_engine.is_none() {
+            let duration = py_samples.shape()[1];
+            self.correlation_engine = Some(build_correlation_engine(
+                duration,
+                self.power_consumption_models.len() * 256,
+                false,
+                &DeviceSelection::default(),
+                None,
+            )?);
         }
+
+        // Generate guesses for all possible bytes, for each combination
+        let guesses = estimate_guesses(&self.power_consumption_models, &payloads, self.k_index);
+        let samples = array_to_columns(py_samples);
+
+        update_correlation_engine(self.correlation_engine.as_mut().unwrap(), samples, guesses)
     }
 
     fn get_result(&self) -> PyResult<Py<PyArray2<f64>>> {
+        correlation_result(self.correlation_engine.as_ref())
+    }
+}
+
+fn array_to_rows(py_array: PyReadonlyArray2<f64>) -> Vec<Vec<f64>> {
+    py_array
+        .as_array()
+        .rows()
+        .into_iter()
+        .map(|row| row.to_vec())
+        .collect()
+}
+
+fn array_to_columns(py_array: PyReadonlyArray2<f64>) -> Vec<Vec<f64>> {
+    py_array
+        .as_array()
+        .columns()
+        .into_iter()
+        .map(|column| column.to_vec())
+        .collect()
+}
+
+#[pyclass]
+struct MultiModelCpaSolver {
+    correlation_engine: Option<ShardedCorrelationEngine>,
+    // One power consumption model per (model, beta, args) variant
+    power_consumption_models: Vec<Box<dyn ConsumptionModelTrait>>,
+    k_index: usize,
+}
+
+#[pymethods]
+impl MultiModelCpaSolver {
+    #[new]
+    fn new(k_index: usize, variants: Vec<(&str, f64, Option<&PyDict>)>) -> PyResult<Self> {
+        if variants.is_empty() {
+            return Err(PyErr::new::<PyTypeError, _>(
+                "At least one variant must be provided",
+            ));
+        }
+
+        let power_consumption_models = variants
+            .iter()
+            .map(|(name, beta_modifier, py_kwargs)| {
+                get_power_consumption_model(name, *py_kwargs, *beta_modifier)
+            })
+            .collect::<PyResult<Vec<_>>>()?;
+
+        let ret = MultiModelCpaSolver {
+            correlation_engine: None,
+            power_consumption_models,
+            k_index,
+        };
+        Ok(ret)
+    }
+
+    fn update(
+        &mut self,
+        payloads: Vec<[u8; 16]>,
+        py_samples: PyReadonlyArray2<f64>,
+    ) -> PyResult<()> {
+        // Instantiate a correlation engine if needed
         if self.correlation_engine.is_none() {
+            let duration = py_samples.shape()[1];
+            self.correlation_engine = Some(build_correlation_engine(
+                duration,
+                self.power_consumption_models.len() * 256,
+                false,
+                &DeviceSelection::default(),
+                None,
+            )?);
+        }
+
+        // Generate guesses for all possible bytes, for each variant.
+        // The sample moments are shared by all the variants.
+        let guesses = estimate_guesses(&self.power_consumption_models, &payloads, self.k_index);
+        let samples = array_to_columns(py_samples);
+
+        update_correlation_engine(self.correlation_engine.as_mut().unwrap(), samples, guesses)
+    }
+
+    // Correlation values, shaped (n_variants * 256, duration)
+    fn get_result(&self) -> PyResult<Py<PyArray2<f64>>> {
+        correlation_result(self.correlation_engine.as_ref())
+    }
+}
+
+#[pyclass]
+struct TemplateProfiler {
+    profiling_engine: Option<TemplateProfilingEngine>,
+    power_consumption_model: Box<dyn ConsumptionModelTrait>,
+    k_index: usize,
+    key_byte: u8,
+}
+
+#[pymethods]
+impl TemplateProfiler {
+    #[new]
+    fn new(
+        name: &str,
+        k_index: usize,
+        key_byte: u8,
+        py_kwargs: Option<&PyDict>,
+    ) -> PyResult<Self> {
+        let power_consumption_model = get_power_consumption_model(name, py_kwargs, 1.0)?;
+
+        let ret = TemplateProfiler {
+            profiling_engine: None,
+            power_consumption_model,
+            k_index,
+            key_byte,
+        };
+        Ok(ret)
+    }
+
+    fn update(
+        &mut self,
+        payloads: Vec<[u8; 16]>,
+        py_samples: PyReadonlyArray2<f64>,
+    ) -> PyResult<()> {
+        // Instantiate a profiling engine if needed
+        if self.profiling_engine.is_none() {
+            let duration = py_samples.shape()[1];
+            self.profiling_engine = Some(TemplateProfilingEngine::new(duration));
+        }
+
+        // Intermediate values of the known key
+        let classes: Vec<u8> = payloads
+            .iter()
+            .map(|c| {
+                self.power_consumption_model
+                    .intermediate(c, self.key_byte, self.k_index)
+            })
+            .collect();
+
+        let samples = array_to_rows(py_samples);
+
+        let profiling_engine = self.profiling_engine.as_mut().unwrap();
+        profiling_engine.update(&samples, &classes);
+
+        Ok(())
+    }
+
+    fn get_templates(
+        &self,
+        projection: &str,
+        n_components: usize,
+    ) -> PyResult<(Py<PyArray2<f64>>, Py<PyArray2<f64>>, Py<PyArray2<f64>>)> {
+        if self.profiling_engine.is_none() {
             return Err(PyErr::new::<PyTypeError, _>("No results"));
         }
-        let correlation_engine = self.correlation_engine.as_ref().unwrap();
-        let result = match correlation_engine.get_result() {
-            Ok(result) => result,
+
+        let projection = match projection {
+            "none" => Projection::None,
+            "pca" => Projection::Pca,
+            "lda" => Projection::Lda,
+            _ => return Err(PyErr::new::<PyTypeError, _>("Unknown projection name")),
+        };
+
+        let profiling_engine = self.profiling_engine.as_ref().unwrap();
+        let templates = match profiling_engine.get_templates(projection, n_components) {
+            Ok(templates) => templates,
             Err(e) => {
-                let msg = format!("Cannot get correlation results: {:?}", e);
+                let msg = format!("Cannot build templates: {:?}", e);
                 return Err(PyErr::new::<PyTypeError, _>(msg));
             }
         };
 
+        let ret = Python::with_gil(|py| {
+            (
+                PyArray2::from_vec2(py, &templates.projection)
+                    .unwrap()
+                    .to_owned(),
+                PyArray2::from_vec2(py, &templates.means).unwrap().to_owned(),
+                PyArray2::from_vec2(py, &templates.covariance)
+                    .unwrap()
+                    .to_owned(),
+            )
+        });
+
+        Ok(ret)
+    }
+}
+
+#[pyclass]
+struct TemplateAttackSolver {
+    attack_engine: TemplateAttackEngine,
+    power_consumption_model: Box<dyn ConsumptionModelTrait>,
+    k_index: usize,
+}
+
+#[pymethods]
+impl TemplateAttackSolver {
+    #[new]
+    fn new(
+        name: &str,
+        k_index: usize,
+        projection: PyReadonlyArray2<f64>,
+        means: PyReadonlyArray2<f64>,
+        covariance: PyReadonlyArray2<f64>,
+        py_kwargs: Option<&PyDict>,
+    ) -> PyResult<Self> {
+        let power_consumption_model = get_power_consumption_model(name, py_kwargs, 1.0)?;
+
+        let templates = Templates {
+            projection: array_to_rows(projection),
+            means: array_to_rows(means),
+            covariance: array_to_rows(covariance),
+        };
+
+        let attack_engine = match TemplateAttackEngine::new(templates) {
+            Ok(engine) => engine,
+            Err(e) => {
+                let msg = format!("Cannot build template attack engine: {:?}", e);
+                return Err(PyErr::new::<PyTypeError, _>(msg));
+            }
+        };
+
+        let ret = TemplateAttackSolver {
+            attack_engine,
+            power_consumption_model,
+            k_index,
+        };
+        Ok(ret)
+    }
+
+    fn update(
+        &mut self,
+        payloads: Vec<[u8; 16]>,
+        py_samples: PyReadonlyArray2<f64>,
+    ) -> PyResult<()> {
+        // Intermediate values for all possible bytes
+        let classes: Vec<Vec<u8>> = payloads
+            .iter()
+            .map(|c| {
+                (0..=u8::MAX)
+                    .map(|i| self.power_consumption_model.intermediate(c, i, self.k_index))
+                    .collect()
+            })
+            .collect();
+
+        let samples = array_to_rows(py_samples);
+
+        self.attack_engine.update(&samples, &classes);
+
+        Ok(())
+    }
+
+    fn get_result(&self) -> PyResult<Py<PyArray1<f64>>> {
+        let result = self.attack_engine.get_result();
+
+        let ret = Python::with_gil(|py| -> Py<PyArray1<f64>> {
+            PyArray1::from_vec(py, result).to_owned()
+        });
+
+        Ok(ret)
+    }
+}
+
+#[pyclass]
+struct LraSolver {
+    regression_engine: Option<LinearRegressionEngine>,
+    power_consumption_model: Box<dyn ConsumptionModelTrait>,
+    k_index: usize,
+}
+
+#[pymethods]
+impl LraSolver {
+    #[new]
+    fn new(name: &str, k_index: usize, py_kwargs: Option<&PyDict>) -> PyResult<Self> {
+        let power_consumption_model = get_power_consumption_model(name, py_kwargs, 1.0)?;
+
+        let ret = LraSolver {
+            regression_engine: None,
+            power_consumption_model,
+            k_index,
+        };
+        Ok(ret)
+    }
+
+    fn update(
+        &mut self,
+        payloads: Vec<[u8; 16]>,
+        py_samples: PyReadonlyArray2<f64>,
+    ) -> PyResult<()> {
+        // Instantiate a regression engine if needed
+        if self.regression_engine.is_none() {
+            let duration = py_samples.shape()[1];
+            self.regression_engine = Some(LinearRegressionEngine::new(duration));
+        }
+
+        // Intermediate values for all possible bytes
+        let intermediates: Vec<Vec<u8>> = payloads
+            .iter()
+            .map(|c| {
+                (0..=u8::MAX)
+                    .map(|i| self.power_consumption_model.intermediate(c, i, self.k_index))
+                    .collect()
+            })
+            .collect();
+
+        let samples = array_to_rows(py_samples);
+
+        let regression_engine = self.regression_engine.as_mut().unwrap();
+        regression_engine.update(&samples, &intermediates);
+
+        Ok(())
+    }
+
+    fn get_result(&self) -> PyResult<Py<PyArray2<f64>>> {
+        if self.regression_engine.is_none() {
+            return Err(PyErr::new::<PyTypeError, _>("No results"));
+        }
+        let regression_engine = self.regression_engine.as_ref().unwrap();
+        let result = regression_engine.get_result();
+
+        let ret = Python::with_gil(|py| -> Py<PyArray2<f64>> {
+            let test = PyArray2::from_vec2(py, &result).unwrap();
+            test.to_owned()
+        });
+
+        Ok(ret)
+    }
+}
+
+#[pyclass]
+struct MiaSolver {
+    mia_engine: Option<MiaEngine>,
+    power_consumption_model: Box<dyn ConsumptionModelTrait>,
+    k_index: usize,
+    n_bins: usize,
+}
+
+#[pymethods]
+impl MiaSolver {
+    #[new]
+    #[pyo3(signature = (name, k_index, py_kwargs=None, n_bins=16))]
+    fn new(
+        name: &str,
+        k_index: usize,
+        py_kwargs: Option<&PyDict>,
+        n_bins: usize,
+    ) -> PyResult<Self> {
+        if !(2..=256).contains(&n_bins) {
+            return Err(PyErr::new::<PyTypeError, _>(
+                "Number of bins must be between 2 and 256",
+            ));
+        }
+        let power_consumption_model = get_power_consumption_model(name, py_kwargs, 1.0)?;
+
+        let ret = MiaSolver {
+            mia_engine: None,
+            power_consumption_model,
+            k_index,
+            n_bins,
+        };
+        Ok(ret)
+    }
+
+    fn update(
+        &mut self,
+        py: Python,
+        payloads: Vec<[u8; 16]>,
+        py_samples: PyReadonlyArray2<f64>,
+    ) -> PyResult<()> {
+        // Instantiate an MIA engine if needed
+        if self.mia_engine.is_none() {
+            let duration = py_samples.shape()[1];
+            self.mia_engine = Some(MiaEngine::new(duration, self.n_bins));
+        }
+
+        // Intermediate values for all possible bytes
+        let intermediates: Vec<Vec<u8>> = payloads
+            .iter()
+            .map(|c| {
+                (0..=u8::MAX)
+                    .map(|i| self.power_consumption_model.intermediate(c, i, self.k_index))
+                    .collect()
+            })
+            .collect();
+
+        let samples = array_to_rows(py_samples);
+
+        let mia_engine = self.mia_engine.as_mut().unwrap();
+        py.allow_threads(|| mia_engine.update(&samples, &intermediates));
+
+        Ok(())
+    }
+
+    fn get_result(&self) -> PyResult<Py<PyArray2<f64>>> {
+        if self.mia_engine.is_none() {
+            return Err(PyErr::new::<PyTypeError, _>("No results"));
+        }
+        let mia_engine = self.mia_engine.as_ref().unwrap();
+        let result = mia_engine.get_result();
+
         let ret = Python::with_gil(|py| -> Py<PyArray2<f64>> {
             let test = PyArray2::from_vec2(py, &result).unwrap();
             test.to_owned()
@@ -185,16 +945,233 @@ impl CpaSolver {
     }
 }
 
+#[pyclass]
+struct SnrSolver {
+    snr_engine: Option<SnrEngine>,
+}
+
+#[pymethods]
+impl SnrSolver {
+    #[new]
+    fn new() -> Self {
+        SnrSolver { snr_engine: None }
+    }
+
+    fn update(
+        &mut self,
+        payloads: Vec<[u8; 16]>,
+        py_samples: PyReadonlyArray2<f64>,
+    ) -> PyResult<()> {
+        // Instantiate an SNR engine if needed
+        if self.snr_engine.is_none() {
+            let duration = py_samples.shape()[1];
+            self.snr_engine = Some(SnrEngine::new(duration));
+        }
+
+        let samples = array_to_rows(py_samples);
+
+        let snr_engine = self.snr_engine.as_mut().unwrap();
+        snr_engine.update(&payloads, &samples);
+
+        Ok(())
+    }
+
+    fn get_result(&self) -> PyResult<(Py<PyArray2<f64>>, Py<PyArray2<f64>>)> {
+        if self.snr_engine.is_none() {
+            return Err(PyErr::new::<PyTypeError, _>("No results"));
+        }
+        let snr_engine = self.snr_engine.as_ref().unwrap();
+        let (snr, nicv) = snr_engine.get_result();
+
+        let ret = Python::with_gil(|py| {
+            (
+                PyArray2::from_vec2(py, &snr).unwrap().to_owned(),
+                PyArray2::from_vec2(py, &nicv).unwrap().to_owned(),
+            )
+        });
+
+        Ok(ret)
+    }
+}
+
+#[pyclass]
+struct CollisionSolver {
+    collision_engine: Option<CollisionEngine>,
+}
+
+#[pymethods]
+impl CollisionSolver {
+    #[new]
+    fn new() -> Self {
+        CollisionSolver {
+            collision_engine: None,
+        }
+    }
+
+    fn update(
+        &mut self,
+        py: Python,
+        payloads: Vec<[u8; 16]>,
+        py_samples: PyReadonlyArray2<f64>,
+    ) -> PyResult<()> {
+        // Instantiate a collision engine if needed
+        if self.collision_engine.is_none() {
+            let duration = py_samples.shape()[1];
+            self.collision_engine = Some(CollisionEngine::new(duration));
+        }
+
+        let samples = array_to_rows(py_samples);
+
+        let collision_engine = self.collision_engine.as_mut().unwrap();
+        py.allow_threads(|| collision_engine.update(&payloads, &samples));
+
+        Ok(())
+    }
+
+    // Collision score of each delta = k_i ^ k_j, for each pair of bytes:
+    // 16 x 16 x 256
+    fn get_result<'py>(&self, py: Python<'py>) -> PyResult<&'py PyArray3<f64>> {
+        let Some(collision_engine) = self.collision_engine.as_ref() else {
+            return Err(PyErr::new::<PyTypeError, _>("No results"));
+        };
+        let result = py.allow_threads(|| collision_engine.get_result());
+        Ok(PyArray1::from_vec(py, result).reshape([16, 16, 256])?)
+    }
+}
+
+// Success rate and guessing entropy, see BootstrapEngine. All 16 key bytes
+// are handled by a single solver.
+#[pyclass]
+struct BootstrapSolver {
+    bootstrap_engine: Option<BootstrapEngine>,
+    power_consumption_model: Box<dyn ConsumptionModelTrait>,
+}
+
+#[pymethods]
+impl BootstrapSolver {
+    #[new]
+    #[pyo3(signature = (name, beta_modifier, py_kwargs=None))]
+    fn new(name: &str, beta_modifier: f64, py_kwargs: Option<&PyDict>) -> PyResult<Self> {
+        let power_consumption_model = get_power_consumption_model(name, py_kwargs, beta_modifier)?;
+
+        Ok(BootstrapSolver {
+            bootstrap_engine: None,
+            power_consumption_model,
+        })
+    }
+
+    // Add one block of traces. All the blocks must have the same size.
+    fn update(
+        &mut self,
+        py: Python,
+        payloads: Vec<[u8; 16]>,
+        py_samples: PyReadonlyArray2<f64>,
+    ) -> PyResult<()> {
+        // Instantiate a bootstrap engine if needed
+        if self.bootstrap_engine.is_none() {
+            let duration = py_samples.shape()[1];
+            self.bootstrap_engine = Some(BootstrapEngine::new(duration));
+        }
+
+        let samples = array_to_rows(py_samples);
+
+        let model = self.power_consumption_model.as_ref();
+        let bootstrap_engine = self.bootstrap_engine.as_mut().unwrap();
+        py.allow_threads(|| {
+            bootstrap_engine
+                .update(model, &payloads, &samples)
+                .map_err(|e| e.to_string())
+        })
+        .map_err(|e| PyErr::new::<PyTypeError, _>(format!("Cannot update: {}", e)))
+    }
+
+    // Number of traces per block
+    fn block_size(&self) -> usize {
+        self.bootstrap_engine.as_ref().map_or(0, |e| e.block_size())
+    }
+
+    // Key byte ranks after each block, for random block orderings:
+    // n_permutations x n_blocks x 16
+    #[pyo3(signature = (key, n_permutations, seed=None))]
+    fn get_ranks<'py>(
+        &self,
+        py: Python<'py>,
+        key: [u8; 16],
+        n_permutations: usize,
+        seed: Option<u64>,
+    ) -> PyResult<&'py PyArray3<u16>> {
+        let Some(bootstrap_engine) = self.bootstrap_engine.as_ref() else {
+            return Err(PyErr::new::<PyTypeError, _>("No results"));
+        };
+        let n_blocks = bootstrap_engine.n_blocks();
+        let ranks = py.allow_threads(|| bootstrap_engine.ranks(&key, n_permutations, seed));
+        Ok(PyArray1::from_vec(py, ranks).reshape([n_permutations, n_blocks, 16])?)
+    }
+}
+
+#[pyclass]
+struct TraceAligner {
+    alignment_engine: AlignmentEngine,
+}
+
+#[pymethods]
+impl TraceAligner {
+    #[new]
+    fn new(
+        py_reference: PyReadonlyArray1<f64>,
+        offset: usize,
+        max_shift: usize,
+        elastic_radius: usize,
+    ) -> PyResult<Self> {
+        let reference = py_reference.as_array().to_vec();
+        if reference.len() < 2 {
+            return Err(PyErr::new::<PyTypeError, _>(
+                "Reference must be at least 2 samples long",
+            ));
+        }
+
+        Ok(TraceAligner {
+            alignment_engine: AlignmentEngine::new(&reference, offset, max_shift, elastic_radius),
+        })
+    }
+
+    fn align(
+        &self,
+        py_samples: PyReadonlyArray2<f64>,
+    ) -> PyResult<(Py<PyArray2<f64>>, Py<PyArray1<f64>>)> {
+        let samples = array_to_rows(py_samples);
+        if samples.is_empty() {
+            return Err(PyErr::new::<PyTypeError, _>("No samples"));
+        }
+        if let Err(msg) = self.alignment_engine.check_length(samples[0].len()) {
+            return Err(PyErr::new::<PyTypeError, _>(msg));
+        }
+
+        let (aligned, shifts) = self.alignment_engine.align(&samples);
+
+        let ret = Python::with_gil(|py| {
+            (
+                PyArray2::from_vec2(py, &aligned).unwrap().to_owned(),
+                PyArray1::from_vec(py, shifts).to_owned(),
+            )
+        });
+
+        Ok(ret)
+    }
+}
+
 #[pyclass]
 struct AssessmentSolver {
-    correlation_engine: Option<OpenclCorrelationEngine>,
+    correlation_engine: Option<ShardedCorrelationEngine>,
     keys: Vec<[u8; 16]>,
+    selection: DeviceSelection,
 }
 
 #[pymethods]
 impl AssessmentSolver {
     #[new]
-    fn new(keys: Vec<[u8; 16]>) -> PyResult<Self> {
+    #[pyo3(signature = (keys, platform=None, device=None))]
+    fn new(keys: Vec<[u8; 16]>, platform: Option<usize>, device: Option<usize>) -> PyResult<Self> {
         if keys.len() != 11 {
             return Err(PyErr::new::<PyTypeError, _>("11 keys must be provided"));
         }
@@ -202,6 +1179,7 @@ impl AssessmentSolver {
         let ret = AssessmentSolver {
             correlation_engine: None,
             keys,
+            selection: DeviceSelection { platform, device },
         };
         Ok(ret)
     }
@@ -218,15 +1196,13 @@ impl AssessmentSolver {
             // Check length of AES states power vector
             let dummy_payload = [0u8; 16];
             let dummy_states = aes::compute_all_states(&dummy_payload, &self.keys);
-            let correlation_engine =
-                match OpenclCorrelationEngine::new(duration, dummy_states.len()) {
-                    Ok(engine) => engine,
-                    Err(e) => {
-                        let msg = format!("Cannot build correlation engine: {:?}", e);
-                        return Err(PyErr::new::<PyTypeError, _>(msg));
-                    }
-                };
-            self.correlation_engine = Some(correlation_engine);
+            self.correlation_engine = Some(build_correlation_engine(
+                duration,
+                dummy_states.len(),
+                false,
+                &self.selection,
+                None,
+            )?);
         }
 
         // Generate power consumption values for all possible payloads
@@ -249,50 +1225,179 @@ impl AssessmentSolver {
             power_consumption.push(v);
         }
 
-        let mut samples: Vec<Vec<f64>> = Vec::new();
-        let py_samples = py_samples.as_array();
+        let samples = array_to_columns(py_samples);
 
-        for column in py_samples.columns() {
-            let v = column.to_vec();
-            samples.push(v);
-        }
+        update_correlation_engine(
+            self.correlation_engine.as_mut().unwrap(),
+            samples,
+            power_consumption,
+        )
+    }
 
-        let correlation_engine = self.correlation_engine.as_mut().unwrap();
-        match correlation_engine.update(samples, power_consumption) {
-            Ok(_) => Ok(()),
-            Err(e) => {
-                let msg = format!("Cannot update correlation engine: {:?}", e);
-                Err(PyErr::new::<PyTypeError, _>(msg))
-            }
+    fn get_result(&self) -> PyResult<Py<PyArray2<f64>>> {
+        correlation_result(self.correlation_engine.as_ref())
+    }
+}
+
+// Board driven from Rust, see esp_cpa_board.EspCpaBoard for the Python
+// implementation of the protocol
+#[cfg(feature = "capture")]
+#[pyclass]
+struct NativeBoard {
+    engine: CaptureEngine,
+}
+
+#[cfg(feature = "capture")]
+fn capture_error(context: &str, e: Box<dyn std::error::Error + Send + Sync>) -> PyErr {
+    PyErr::new::<PyTypeError, _>(format!("{}: {:?}", context, e))
+}
+
+#[cfg(feature = "capture")]
+#[pymethods]
+impl NativeBoard {
+    // device is a bus path (e.g. "1-2.3") or a serial number, see list_devices()
+    #[new]
+    #[pyo3(signature = (device=None))]
+    fn new(device: Option<&str>) -> PyResult<Self> {
+        match CaptureEngine::open(device) {
+            Ok(engine) => Ok(NativeBoard { engine }),
+            Err(e) => Err(capture_error("Cannot open board", e)),
         }
     }
 
-    fn get_result(&self) -> PyResult<Py<PyArray2<f64>>> {
-        if self.correlation_engine.is_none() {
-            return Err(PyErr::new::<PyTypeError, _>("No results"));
+    // (bus path, serial number) of each connected board
+    #[staticmethod]
+    fn list_devices() -> PyResult<Vec<(String, Option<String>)>> {
+        list_boards().map_err(|e| capture_error("Cannot list boards", e))
+    }
+
+    fn set_dut_power(&self, py: Python, power: bool) -> PyResult<()> {
+        py.allow_threads(|| self.engine.set_dut_power(power))
+            .map_err(|e| capture_error("Cannot set DUT power", e))
+    }
+
+    fn set_clk_en(&self, py: Python, en: bool) -> PyResult<()> {
+        py.allow_threads(|| self.engine.set_clk_en(en))
+            .map_err(|e| capture_error("Cannot set DUT clock", e))
+    }
+
+    fn set_amplifier_gain(&self, py: Python, gain: u32) -> PyResult<()> {
+        py.allow_threads(|| self.engine.set_amplifier_gain(gain))
+            .map_err(|e| capture_error("Cannot set amplifier gain", e))
+    }
+
+    fn set_flash_payload(&self, py: Python, payload: [u8; 16]) -> PyResult<()> {
+        py.allow_threads(|| self.engine.set_flash_payload(&payload))
+            .map_err(|e| capture_error("Cannot set flash payload", e))
+    }
+
+    fn get_temperature(&self, py: Python) -> PyResult<f64> {
+        py.allow_threads(|| self.engine.get_temperature())
+            .map_err(|e| capture_error("Cannot get temperature", e))
+    }
+
+    fn set_heater_pwm(&self, py: Python, value: u32) -> PyResult<()> {
+        py.allow_threads(|| self.engine.set_heater_pwm(value))
+            .map_err(|e| capture_error("Cannot set heater PWM", e))
+    }
+
+    #[pyo3(signature = (n_samples=0x8000, n_measurements=1))]
+    fn perform_measurement(
+        &self,
+        py: Python,
+        n_samples: usize,
+        n_measurements: usize,
+    ) -> PyResult<Py<PyArray2<i16>>> {
+        let samples = py
+            .allow_threads(|| self.engine.perform_measurement(n_samples, n_measurements))
+            .map_err(|e| capture_error("Cannot perform measurement", e))?;
+        let samples = PyArray1::from_vec(py, samples).reshape([n_measurements, n_samples])?;
+        Ok(samples.to_owned())
+    }
+
+    // Capture chunk_size measurements with random payloads, without releasing
+    // control to Python in between. Returns the payloads, shaped (chunk_size, 16),
+    // and the samples, shaped (chunk_size, averaging, n_samples).
+    fn capture_chunk(
+        &self,
+        py: Python,
+        chunk_size: usize,
+        averaging: usize,
+        n_samples: usize,
+    ) -> PyResult<(Py<PyArray2<u8>>, Py<PyArray3<i16>>)> {
+        let chunk = py
+            .allow_threads(|| self.engine.capture_chunk(chunk_size, averaging, n_samples))
+            .map_err(|e| capture_error("Cannot capture chunk", e))?;
+        let payloads = PyArray1::from_vec(py, chunk.payloads).reshape([chunk_size, 16])?;
+        let samples =
+            PyArray1::from_vec(py, chunk.samples).reshape([chunk_size, averaging, n_samples])?;
+        Ok((payloads.to_owned(), samples.to_owned()))
+    }
+
+    // Cumulative counters, the capture time is in seconds
+    fn stats(&self) -> HashMap<&'static str, f64> {
+        let engine_stats = self.engine.stats();
+        let mut stats = HashMap::new();
+        stats.insert("n_measurements", engine_stats.n_measurements as f64);
+        stats.insert("capture", engine_stats.capture_ns as f64 * 1e-9);
+        stats
+    }
+}
+
+// (platform index, device index, platform name, device name) of each OpenCL device
+#[pyfunction]
+fn opencl_devices() -> PyResult<Vec<(usize, usize, String, String)>> {
+    match list_devices() {
+        Ok(devices) => Ok(devices),
+        Err(e) => {
+            let msg = format!("Cannot list OpenCL devices: {:?}", e);
+            Err(PyErr::new::<PyTypeError, _>(msg))
         }
-        let correlation_engine = self.correlation_engine.as_ref().unwrap();
-        let result = match correlation_engine.get_result() {
-            Ok(result) => result,
-            Err(e) => {
-                let msg = format!("Cannot get correlation results: {:?}", e);
-                return Err(PyErr::new::<PyTypeError, _>(msg));
-            }
-        };
+    }
+}
 
-        let ret = Python::with_gil(|py| -> Py<PyArray2<f64>> {
-            let test = PyArray2::from_vec2(py, &result).unwrap();
-            test.to_owned()
-        });
+// Compress 12-bit samples, see sample_codec
+#[pyfunction]
+fn encode_samples<'py>(
+    py: Python<'py>,
+    samples: PyReadonlyArray1<i16>,
+) -> PyResult<&'py PyBytes> {
+    let samples = samples.as_slice()?;
+    let encoded = py.allow_threads(|| sample_codec::encode(samples));
+    Ok(PyBytes::new(py, &encoded))
+}
 
-        Ok(ret)
+#[pyfunction]
+fn decode_samples<'py>(py: Python<'py>, encoded: &[u8]) -> PyResult<&'py PyArray1<i16>> {
+    match py.allow_threads(|| sample_codec::decode(encoded)) {
+        Ok(samples) => Ok(PyArray1::from_vec(py, samples)),
+        Err(e) => {
+            let msg = format!("Cannot decode samples: {:?}", e);
+            Err(PyErr::new::<PyTypeError, _>(msg))
+        }
     }
 }
 
 #[pymodule]
 fn cpa_lib(_py: Python, m: &PyModule) -> PyResult<()> {
+    m.add_function(wrap_pyfunction!(opencl_devices, m)?)?;
+    m.add_function(wrap_pyfunction!(encode_samples, m)?)?;
+    m.add_function(wrap_pyfunction!(decode_samples, m)?)?;
     m.add_class::<CpaSolver>()?;
+    m.add_class::<WindowedCpaSolver>()?;
+    m.add_class::<FanoutCpaSolver>()?;
+    m.add_class::<MultiModelCpaSolver>()?;
+    m.add_class::<TemplateProfiler>()?;
+    m.add_class::<TemplateAttackSolver>()?;
+    m.add_class::<LraSolver>()?;
+    m.add_class::<MiaSolver>()?;
+    m.add_class::<SnrSolver>()?;
+    m.add_class::<BootstrapSolver>()?;
+    m.add_class::<CollisionSolver>()?;
+    m.add_class::<TraceAligner>()?;
     m.add_class::<AssessmentSolver>()?;
+    #[cfg(feature = "capture")]
+    m.add_class::<NativeBoard>()?;
 
     Ok(())
 }
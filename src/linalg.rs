@@ -0,0 +1,134 @@
+// Minimal dense linear algebra helpers, for small (POI-sized) matrices
+
+pub type Matrix = Vec<Vec<f64>>;
+
+pub fn identity(n: usize) -> Matrix {
+    (0..n)
+        .map(|i| (0..n).map(|j| if i == j { 1.0 } else { 0.0 }).collect())
+        .collect()
+}
+
+pub fn transpose(a: &Matrix) -> Matrix {
+    if a.is_empty() {
+        return Vec::new();
+    }
+    (0..a[0].len())
+        .map(|j| a.iter().map(|row| row[j]).collect())
+        .collect()
+}
+
+pub fn mul(a: &Matrix, b: &Matrix) -> Matrix {
+    a.iter()
+        .map(|row| {
+            (0..b[0].len())
+                .map(|j| row.iter().zip(b.iter()).map(|(x, r)| x * r[j]).sum())
+                .collect()
+        })
+        .collect()
+}
+
+// Lower triangular L such that L * L^T = a, a being symmetric positive definite
+pub fn cholesky(a: &Matrix) -> Result<Matrix, String> {
+    let n = a.len();
+    let mut l = vec![vec![0.0f64; n]; n];
+
+    for i in 0..n {
+        for j in 0..=i {
+            let s: f64 = (0..j).map(|k| l[i][k] * l[j][k]).sum();
+            if i == j {
+                let d = a[i][i] - s;
+                if d <= 0.0 {
+                    return Err("Matrix is not positive definite".to_string());
+                }
+                l[i][j] = d.sqrt();
+            } else {
+                l[i][j] = (a[i][j] - s) / l[j][j];
+            }
+        }
+    }
+
+    Ok(l)
+}
+
+// Solve L * x = b, L being lower triangular
+pub fn forward_substitution(l: &Matrix, b: &[f64]) -> Vec<f64> {
+    let n = l.len();
+    let mut x = vec![0.0f64; n];
+    for i in 0..n {
+        let s: f64 = (0..i).map(|k| l[i][k] * x[k]).sum();
+        x[i] = (b[i] - s) / l[i][i];
+    }
+    x
+}
+
+// Inverse of a lower triangular matrix
+pub fn lower_triangular_inverse(l: &Matrix) -> Matrix {
+    let n = l.len();
+    let columns: Matrix = identity(n)
+        .iter()
+        .map(|e| forward_substitution(l, e))
+        .collect();
+    transpose(&columns)
+}
+
+// Eigen decomposition of a symmetric matrix (cyclic Jacobi method).
+// Eigenvalues are sorted in decreasing order, eigenvectors are the columns of
+// the returned matrix.
+pub fn symmetric_eigen(a: &Matrix) -> (Vec<f64>, Matrix) {
+    let n = a.len();
+    let mut a = a.clone();
+    let mut v = identity(n);
+
+    for _ in 0..100 {
+        let off: f64 = (0..n)
+            .flat_map(|i| (0..n).filter(move |&j| j != i).map(move |j| (i, j)))
+            .map(|(i, j)| a[i][j] * a[i][j])
+            .sum();
+        if off < 1e-22 {
+            break;
+        }
+
+        for p in 0..n {
+            for q in (p + 1)..n {
+                if a[p][q].abs() < 1e-300 {
+                    continue;
+                }
+                let theta = (a[q][q] - a[p][p]) / (2.0 * a[p][q]);
+                let t = theta.signum() / (theta.abs() + (theta * theta + 1.0).sqrt());
+                let t = if theta == 0.0 { 1.0 } else { t };
+                let c = 1.0 / (t * t + 1.0).sqrt();
+                let s = t * c;
+
+                for k in 0..n {
+                    let akp = a[k][p];
+                    let akq = a[k][q];
+                    a[k][p] = c * akp - s * akq;
+                    a[k][q] = s * akp + c * akq;
+                }
+                for k in 0..n {
+                    let apk = a[p][k];
+                    let aqk = a[q][k];
+                    a[p][k] = c * apk - s * aqk;
+                    a[q][k] = s * apk + c * aqk;
+                }
+                for row in v.iter_mut() {
+                    let vkp = row[p];
+                    let vkq = row[q];
+                    row[p] = c * vkp - s * vkq;
+                    row[q] = s * vkp + c * vkq;
+                }
+            }
+        }
+    }
+
+    let mut order: Vec<usize> = (0..n).collect();
+    order.sort_by(|&i, &j| a[j][j].partial_cmp(&a[i][i]).unwrap());
+
+    let values = order.iter().map(|&i| a[i][i]).collect();
+    let vectors = v
+        .iter()
+        .map(|row| order.iter().map(|&i| row[i]).collect())
+        .collect();
+
+    (values, vectors)
+}
@@ -0,0 +1,142 @@
+use std::thread;
+
+const N_GUESSES: usize = 256;
+
+// Hypothesis classes: Hamming weight of the 8-bit intermediate value
+const N_CLASSES: usize = 9;
+
+// Mutual information analysis. Joint histograms of (quantized sample,
+// hypothesis class) are accumulated for each guess and each sample, in integer
+// counters. The bin edges of each sample are the quantiles of the first
+// update, so that the bins are about equally populated.
+pub struct MiaEngine {
+    duration: usize,
+    n_bins: usize,
+    edges: Vec<Vec<f64>>, // Per sample, n_bins - 1 inner edges
+    n: u64,
+    counts: Vec<u32>, // N_GUESSES x duration x N_CLASSES x n_bins
+}
+
+impl MiaEngine {
+    pub fn new(duration: usize, n_bins: usize) -> Self {
+        MiaEngine {
+            duration,
+            n_bins,
+            edges: Vec::new(),
+            n: 0,
+            counts: vec![0; N_GUESSES * duration * N_CLASSES * n_bins],
+        }
+    }
+
+    fn set_edges(&mut self, samples: &[Vec<f64>]) {
+        self.edges = (0..self.duration)
+            .map(|t| {
+                let mut column: Vec<f64> = samples.iter().map(|x| x[t]).collect();
+                column.sort_by(|a, b| a.total_cmp(b));
+                (1..self.n_bins)
+                    .map(|b| column[b * (column.len() - 1) / self.n_bins])
+                    .collect()
+            })
+            .collect();
+    }
+
+    // intermediates[n][g] is the intermediate value of trace n under the guess g
+    pub fn update(&mut self, samples: &[Vec<f64>], intermediates: &[Vec<u8>]) {
+        if samples.is_empty() {
+            return;
+        }
+        if self.edges.is_empty() {
+            self.set_edges(samples);
+        }
+
+        // Bins are shared by all the guesses
+        let edges = &self.edges;
+        let bins: Vec<Vec<u8>> = samples
+            .iter()
+            .map(|x| {
+                x.iter()
+                    .zip(edges.iter())
+                    .map(|(v, e)| e.partition_point(|edge| edge <= v) as u8)
+                    .collect()
+            })
+            .collect();
+        let classes: Vec<Vec<u8>> = intermediates
+            .iter()
+            .map(|values| values.iter().map(|v| v.count_ones() as u8).collect())
+            .collect();
+
+        // Each thread owns the counters of a range of guesses
+        let n_threads = thread::available_parallelism()
+            .map(|n| n.get())
+            .unwrap_or(1);
+        let guesses_per_thread = (N_GUESSES + n_threads - 1) / n_threads;
+        let guess_stride = self.duration * N_CLASSES * self.n_bins;
+        let n_bins = self.n_bins;
+
+        thread::scope(|scope| {
+            for (n, counts) in self
+                .counts
+                .chunks_mut(guesses_per_thread * guess_stride)
+                .enumerate()
+            {
+                let (bins, classes) = (&bins, &classes);
+                scope.spawn(move || {
+                    let first_guess = n * guesses_per_thread;
+                    for (trace_bins, trace_classes) in bins.iter().zip(classes.iter()) {
+                        for (g, counts) in counts.chunks_exact_mut(guess_stride).enumerate() {
+                            let class = trace_classes[first_guess + g] as usize;
+                            for (t, &bin) in trace_bins.iter().enumerate() {
+                                counts[(t * N_CLASSES + class) * n_bins + bin as usize] += 1;
+                            }
+                        }
+                    }
+                });
+            }
+        });
+
+        self.n += samples.len() as u64;
+    }
+
+    // Mutual information between each sample and the hypothesis classes of
+    // each guess, in bits
+    pub fn get_result(&self) -> Vec<Vec<f64>> {
+        let n = self.n as f64;
+        let guess_stride = self.duration * N_CLASSES * self.n_bins;
+        if self.n == 0 {
+            return vec![vec![0.0; self.duration]; N_GUESSES];
+        }
+
+        self.counts
+            .chunks_exact(guess_stride)
+            .map(|counts| {
+                counts
+                    .chunks_exact(N_CLASSES * self.n_bins)
+                    .map(|joint| {
+                        let mut class_counts = [0u64; N_CLASSES];
+                        let mut bin_counts = vec![0u64; self.n_bins];
+                        for (c, row) in joint.chunks_exact(self.n_bins).enumerate() {
+                            for (b, &count) in row.iter().enumerate() {
+                                class_counts[c] += count as u64;
+                                bin_counts[b] += count as u64;
+                            }
+                        }
+
+                        let mut mi = 0.0;
+                        for (c, row) in joint.chunks_exact(self.n_bins).enumerate() {
+                            for (b, &count) in row.iter().enumerate() {
+                                if count == 0 {
+                                    continue;
+                                }
+                                let count = count as f64;
+                                mi += count / n
+                                    * (count * n / (class_counts[c] as f64 * bin_counts[b] as f64))
+                                        .log2();
+                            }
+                        }
+                        mi
+                    })
+                    .collect()
+            })
+            .collect()
+    }
+}
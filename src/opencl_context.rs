@@ -0,0 +1,228 @@
+use ocl::enums::{DeviceInfo, ProgramInfo, ProgramInfoResult};
+use ocl::{Context, Device, Platform, Program};
+use std::collections::hash_map::DefaultHasher;
+use std::collections::HashMap;
+use std::env;
+use std::error::Error;
+use std::fs;
+use std::hash::{Hash, Hasher};
+use std::path::PathBuf;
+use std::sync::{Mutex, OnceLock};
+
+// Environment variables used when no explicit selection is made
+const PLATFORM_ENV: &str = "CPA_LIB_PLATFORM";
+const DEVICE_ENV: &str = "CPA_LIB_DEVICE";
+const CACHE_DIR_ENV: &str = "CPA_LIB_CACHE_DIR";
+
+// OpenCL platform and device indexes, see list_devices()
+#[derive(Clone, Copy, Default, PartialEq, Eq, Hash)]
+pub struct DeviceSelection {
+    pub platform: Option<usize>,
+    pub device: Option<usize>,
+}
+
+impl DeviceSelection {
+    // Explicit indexes take precedence over the environment variables.
+    // Without any of them, the first device of the first platform is used.
+    fn resolve(&self) -> Result<(usize, usize), Box<dyn Error>> {
+        let from_env = |name: &str| -> Result<Option<usize>, Box<dyn Error>> {
+            match env::var(name) {
+                Ok(value) => Ok(Some(value.trim().parse()?)),
+                Err(_) => Ok(None),
+            }
+        };
+        let platform = match self.platform {
+            Some(p) => p,
+            None => from_env(PLATFORM_ENV)?.unwrap_or(0),
+        };
+        let device = match self.device {
+            Some(d) => d,
+            None if all_devices_requested() => 0,
+            None => from_env(DEVICE_ENV)?.unwrap_or(0),
+        };
+        Ok((platform, device))
+    }
+
+    // Devices to shard the work across. When CPA_LIB_DEVICE is "all" and no
+    // device is given, every device of the platform is used (of every platform
+    // if none is given either). Otherwise, the single selected device.
+    pub fn expand(&self) -> Result<Vec<DeviceSelection>, Box<dyn Error>> {
+        if self.device.is_some() || !all_devices_requested() {
+            let (platform, device) = self.resolve()?;
+            return Ok(vec![DeviceSelection {
+                platform: Some(platform),
+                device: Some(device),
+            }]);
+        }
+
+        let platform = match self.platform {
+            Some(p) => Some(p),
+            None => match env::var(PLATFORM_ENV) {
+                Ok(value) => Some(value.trim().parse()?),
+                Err(_) => None,
+            },
+        };
+
+        let selections: Vec<DeviceSelection> = list_devices()?
+            .into_iter()
+            .filter(|(p, _, _, _)| platform.map_or(true, |platform| *p == platform))
+            .map(|(p, d, _, _)| DeviceSelection {
+                platform: Some(p),
+                device: Some(d),
+            })
+            .collect();
+        if selections.is_empty() {
+            return Err("No OpenCL device found".into());
+        }
+        Ok(selections)
+    }
+}
+
+fn all_devices_requested() -> bool {
+    env::var(DEVICE_ENV).map_or(false, |value| value.trim() == "all")
+}
+
+// Context and compiled program, shared by all the engines using a device
+#[derive(Clone)]
+pub struct SharedProgram {
+    pub context: Context,
+    pub device: Device,
+    pub program: Program,
+}
+
+// (platform, device, source hash) -> program
+type Registry = Mutex<HashMap<(usize, usize, u64), SharedProgram>>;
+
+fn registry() -> &'static Registry {
+    static REGISTRY: OnceLock<Registry> = OnceLock::new();
+    REGISTRY.get_or_init(|| Mutex::new(HashMap::new()))
+}
+
+pub fn list_devices() -> Result<Vec<(usize, usize, String, String)>, Box<dyn Error>> {
+    let mut result = Vec::new();
+    for (p, platform) in Platform::list().iter().enumerate() {
+        for (d, device) in Device::list_all(platform)?.iter().enumerate() {
+            result.push((p, d, platform.name()?, device.name()?));
+        }
+    }
+    Ok(result)
+}
+
+fn cache_directory() -> Option<PathBuf> {
+    if let Ok(dir) = env::var(CACHE_DIR_ENV) {
+        return Some(PathBuf::from(dir));
+    }
+    if let Ok(dir) = env::var("XDG_CACHE_HOME") {
+        return Some(PathBuf::from(dir).join("cpa_lib"));
+    }
+    env::var("HOME")
+        .ok()
+        .map(|home| PathBuf::from(home).join(".cache").join("cpa_lib"))
+}
+
+fn hash_source(src: &str) -> u64 {
+    let mut hasher = DefaultHasher::new();
+    src.hash(&mut hasher);
+    hasher.finish()
+}
+
+// Binaries are specific to the device and to its driver
+fn binary_cache_path(
+    platform: &Platform,
+    device: &Device,
+    src_hash: u64,
+) -> Result<Option<PathBuf>, Box<dyn Error>> {
+    let Some(dir) = cache_directory() else {
+        return Ok(None);
+    };
+
+    let mut hasher = DefaultHasher::new();
+    src_hash.hash(&mut hasher);
+    platform.name()?.hash(&mut hasher);
+    device.name()?.hash(&mut hasher);
+    device.info(DeviceInfo::DriverVersion)?.to_string().hash(&mut hasher);
+
+    Ok(Some(dir.join(format!("{:016x}.bin", hasher.finish()))))
+}
+
+fn build_program(
+    context: &Context,
+    platform: &Platform,
+    device: &Device,
+    src: &str,
+    src_hash: u64,
+) -> Result<Program, Box<dyn Error>> {
+    let cache_path = binary_cache_path(platform, device, src_hash)?;
+
+    if let Some(path) = cache_path.as_ref() {
+        if let Ok(binary) = fs::read(path) {
+            let binaries = [&binary[..]];
+            let program = Program::builder()
+                .devices(*device)
+                .binaries(&binaries)
+                .build(context);
+            // Fall back to the source if the cached binary is rejected
+            if let Ok(program) = program {
+                return Ok(program);
+            }
+        }
+    }
+
+    let program = Program::builder()
+        .devices(*device)
+        .src(src)
+        .build(context)?;
+
+    if let Some(path) = cache_path.as_ref() {
+        if let ProgramInfoResult::Binaries(binaries) = program.info(ProgramInfo::Binaries)? {
+            if let Some(binary) = binaries.first() {
+                // The cache is an optimization only, ignore write errors
+                if let Some(dir) = path.parent() {
+                    let _ = fs::create_dir_all(dir);
+                }
+                let _ = fs::write(path, binary);
+            }
+        }
+    }
+
+    Ok(program)
+}
+
+// Get the context and program compiled from src for the selected device,
+// building them on first use only
+pub fn get_program(
+    selection: &DeviceSelection,
+    src: &str,
+) -> Result<SharedProgram, Box<dyn Error>> {
+    let (p, d) = selection.resolve()?;
+    let src_hash = hash_source(src);
+
+    let mut registry = registry().lock().unwrap();
+    if let Some(shared) = registry.get(&(p, d, src_hash)) {
+        return Ok(shared.clone());
+    }
+
+    let platforms = Platform::list();
+    let Some(platform) = platforms.get(p) else {
+        return Err(format!("Invalid OpenCL platform index {}", p).into());
+    };
+    let devices = Device::list_all(platform)?;
+    let Some(device) = devices.get(d) else {
+        return Err(format!("Invalid OpenCL device index {}", d).into());
+    };
+
+    let context = Context::builder()
+        .platform(*platform)
+        .devices(*device)
+        .build()?;
+    let program = build_program(&context, platform, device, src, src_hash)?;
+
+    let shared = SharedProgram {
+        context,
+        device: *device,
+        program,
+    };
+    registry.insert((p, d, src_hash), shared.clone());
+
+    Ok(shared)
+}
@@ -2,6 +2,16 @@ use super::aes;
 
 pub trait ConsumptionModelTrait: Sync + Send {
     fn estimate(&self, payload: &[u8; 16], guess: u8, index: usize) -> f64;
+
+    // Targeted intermediate value, the power consumption is estimated from
+    fn intermediate(&self, payload: &[u8; 16], guess: u8, index: usize) -> u8;
+
+    // Estimate the power consumption of all the possible guesses
+    fn estimate_all(&self, payload: &[u8; 16], index: usize) -> Vec<f64> {
+        (0..=u8::MAX)
+            .map(|guess| self.estimate(payload, guess, index))
+            .collect()
+    }
 }
 
 pub struct ConsumptionModelRound0 {
@@ -27,23 +37,39 @@ impl ConsumptionModelTrait for ConsumptionModelRound0 {
         let p = aes::sbox(payload[index] ^ guess).count_ones() as f64;
         p.powf(self.beta_modifier)
     }
+
+    fn intermediate(&self, payload: &[u8; 16], guess: u8, index: usize) -> u8 {
+        aes::sbox(payload[index] ^ guess)
+    }
 }
 
 impl ConsumptionModelTrait for ConsumptionModelRound1 {
     fn estimate(&self, payload: &[u8; 16], guess: u8, index: usize) -> f64 {
-        let mut aes_state = aes::AesState::new(payload);
-
-        // Run the beginning of the first round
-        aes_state.add_round_key(&self.k0);
-        aes_state.sub_bytes();
-        aes_state.shift_rows();
-        aes_state.mix_columns();
+        let aes_state = self.run_round0(payload);
 
         let p = (aes::sbox(aes_state.data[index] ^ guess)
             ^ aes::sbox(payload[index] ^ self.k0[index]))
         .count_ones() as f64;
         p.powf(self.beta_modifier)
     }
+
+    fn intermediate(&self, payload: &[u8; 16], guess: u8, index: usize) -> u8 {
+        let aes_state = self.run_round0(payload);
+
+        aes::sbox(aes_state.data[index] ^ guess) ^ aes::sbox(payload[index] ^ self.k0[index])
+    }
+
+    fn estimate_all(&self, payload: &[u8; 16], index: usize) -> Vec<f64> {
+        let aes_state = self.run_round0(payload);
+        let previous = aes::sbox(payload[index] ^ self.k0[index]);
+
+        (0..=u8::MAX)
+            .map(|guess| {
+                let p = (aes::sbox(aes_state.data[index] ^ guess) ^ previous).count_ones() as f64;
+                p.powf(self.beta_modifier)
+            })
+            .collect()
+    }
 }
 
 impl ConsumptionModelTrait for ConsumptionModelRound0DecTable {
@@ -57,16 +83,15 @@ impl ConsumptionModelTrait for ConsumptionModelRound0DecTable {
         let p = lut0.count_ones() as f64;
         p.powf(self.beta_modifier)
     }
+
+    fn intermediate(&self, payload: &[u8; 16], guess: u8, index: usize) -> u8 {
+        aes::inv_sbox(payload[index] ^ guess)
+    }
 }
 
 impl ConsumptionModelTrait for ConsumptionModelRound1DecTable {
     fn estimate(&self, payload: &[u8; 16], guess: u8, index: usize) -> f64 {
-        // Run round0
-        let mut aes_state = aes::AesState::new(payload);
-        aes_state.add_round_key(&self.tk0);
-        aes_state.shift_rows_inv();
-        aes_state.sub_bytes_inv();
-        aes_state.mix_columns_inv();
+        let aes_state = self.run_round0(payload);
 
         let i = aes::inv_sbox(aes_state.data[index] ^ guess);
         let lut1: u32 = (aes::gal9(i) as u32)
@@ -77,6 +102,29 @@ impl ConsumptionModelTrait for ConsumptionModelRound1DecTable {
         let p = lut1.count_ones() as f64;
         p.powf(self.beta_modifier)
     }
+
+    fn intermediate(&self, payload: &[u8; 16], guess: u8, index: usize) -> u8 {
+        let aes_state = self.run_round0(payload);
+
+        aes::inv_sbox(aes_state.data[index] ^ guess)
+    }
+
+    fn estimate_all(&self, payload: &[u8; 16], index: usize) -> Vec<f64> {
+        let aes_state = self.run_round0(payload);
+
+        (0..=u8::MAX)
+            .map(|guess| {
+                let i = aes::inv_sbox(aes_state.data[index] ^ guess);
+                let lut1: u32 = (aes::gal9(i) as u32)
+                    | ((aes::gal11(i) as u32) << 8)
+                    | ((aes::gal13(i) as u32) << 16)
+                    | ((aes::gal14(i) as u32) << 24);
+
+                let p = lut1.count_ones() as f64;
+                p.powf(self.beta_modifier)
+            })
+            .collect()
+    }
 }
 
 impl ConsumptionModelRound0 {
@@ -92,6 +140,33 @@ impl ConsumptionModelRound1 {
             beta_modifier,
         }
     }
+
+    fn run_round0(&self, payload: &[u8; 16]) -> aes::AesState {
+        let mut aes_state = aes::AesState::new(payload);
+
+        // Run the beginning of the first round
+        aes_state.add_round_key(&self.k0);
+        aes_state.sub_bytes();
+        aes_state.shift_rows();
+        aes_state.mix_columns();
+
+        aes_state
+    }
+
+    // Indexes of the k0 bytes the round 1 intermediate value at index depends on
+    pub fn key_dependencies(index: usize) -> Vec<usize> {
+        let reference = ConsumptionModelRound1::new(&[0u8; 16], 1.0).run_round0(&[0u8; 16]);
+
+        (0..16)
+            .filter(|&i| {
+                let mut k0 = [0u8; 16];
+                k0[i] = 1;
+                let state = ConsumptionModelRound1::new(&k0, 1.0).run_round0(&[0u8; 16]);
+                // k0[index] is also used to recompute the previous sbox output
+                i == index || state.data[index] != reference.data[index]
+            })
+            .collect()
+    }
 }
 
 impl ConsumptionModelRound0DecTable {
@@ -107,6 +182,33 @@ impl ConsumptionModelRound1DecTable {
             beta_modifier,
         }
     }
+
+    fn run_round0(&self, payload: &[u8; 16]) -> aes::AesState {
+        let mut aes_state = aes::AesState::new(payload);
+
+        // Run round0
+        aes_state.add_round_key(&self.tk0);
+        aes_state.shift_rows_inv();
+        aes_state.sub_bytes_inv();
+        aes_state.mix_columns_inv();
+
+        aes_state
+    }
+
+    // Indexes of the tk0 bytes the round 1 intermediate value at index depends on
+    pub fn key_dependencies(index: usize) -> Vec<usize> {
+        let reference =
+            ConsumptionModelRound1DecTable::new(&[0u8; 16], 1.0).run_round0(&[0u8; 16]);
+
+        (0..16)
+            .filter(|&i| {
+                let mut tk0 = [0u8; 16];
+                tk0[i] = 1;
+                let state = ConsumptionModelRound1DecTable::new(&tk0, 1.0).run_round0(&[0u8; 16]);
+                state.data[index] != reference.data[index]
+            })
+            .collect()
+    }
 }
 
 pub fn state_hamming_weight(state: &[u8; 16]) -> f64 {
@@ -0,0 +1,181 @@
+use std::thread;
+
+use super::linalg::{cholesky, forward_substitution, transpose};
+
+// Constant term, followed by the 8 bits of the intermediate value
+pub const N_COEFFICIENTS: usize = 9;
+
+const N_GUESSES: usize = 256;
+
+// Normal equations of the regression of the samples on the bit-level basis,
+// for every guess
+#[derive(Clone)]
+struct NormalEquations {
+    duration: usize,
+    n: u64,
+    gram: Vec<[[f64; N_COEFFICIENTS]; N_COEFFICIENTS]>, // Per guess
+    moments: Vec<Vec<f64>>,                             // Per guess, N_COEFFICIENTS x duration
+    sum_squares: Vec<f64>,
+}
+
+impl NormalEquations {
+    fn new(duration: usize) -> Self {
+        NormalEquations {
+            duration,
+            n: 0,
+            gram: vec![[[0.0; N_COEFFICIENTS]; N_COEFFICIENTS]; N_GUESSES],
+            moments: vec![vec![0.0; N_COEFFICIENTS * duration]; N_GUESSES],
+            sum_squares: vec![0.0; duration],
+        }
+    }
+
+    fn update(&mut self, x: &[f64], intermediates: &[u8]) {
+        self.n += 1;
+        for (s, v) in self.sum_squares.iter_mut().zip(x.iter()) {
+            *s += v * v;
+        }
+
+        for (guess, value) in intermediates.iter().enumerate() {
+            // Only the non-zero coefficients of the basis contribute
+            let mut active = [0usize; N_COEFFICIENTS];
+            let mut n_active = 1;
+            for bit in 0..8 {
+                if (value >> bit) & 1 == 1 {
+                    active[n_active] = bit + 1;
+                    n_active += 1;
+                }
+            }
+
+            let gram = &mut self.gram[guess];
+            for &i in active[..n_active].iter() {
+                for &j in active[..n_active].iter() {
+                    gram[i][j] += 1.0;
+                }
+            }
+
+            let moments = &mut self.moments[guess];
+            for &i in active[..n_active].iter() {
+                let row = &mut moments[i * self.duration..(i + 1) * self.duration];
+                for (m, v) in row.iter_mut().zip(x.iter()) {
+                    *m += v;
+                }
+            }
+        }
+    }
+
+    fn merge(&mut self, other: &NormalEquations) {
+        self.n += other.n;
+        for (s, o) in self.sum_squares.iter_mut().zip(other.sum_squares.iter()) {
+            *s += o;
+        }
+        for (g, o) in self.gram.iter_mut().zip(other.gram.iter()) {
+            for i in 0..N_COEFFICIENTS {
+                for j in 0..N_COEFFICIENTS {
+                    g[i][j] += o[i][j];
+                }
+            }
+        }
+        for (m, o) in self.moments.iter_mut().zip(other.moments.iter()) {
+            for (a, b) in m.iter_mut().zip(o.iter()) {
+                *a += b;
+            }
+        }
+    }
+}
+
+pub struct LinearRegressionEngine {
+    equations: NormalEquations,
+}
+
+impl LinearRegressionEngine {
+    pub fn new(duration: usize) -> Self {
+        LinearRegressionEngine {
+            equations: NormalEquations::new(duration),
+        }
+    }
+
+    // intermediates[n][g] is the intermediate value of trace n under the guess g
+    pub fn update(&mut self, samples: &[Vec<f64>], intermediates: &[Vec<u8>]) {
+        let n_threads = thread::available_parallelism()
+            .map(|n| n.get())
+            .unwrap_or(1);
+        let chunk_len = (samples.len() + n_threads - 1) / n_threads;
+        if chunk_len == 0 {
+            return;
+        }
+
+        let duration = self.equations.duration;
+        let partials: Vec<NormalEquations> = thread::scope(|scope| {
+            let handles: Vec<_> = samples
+                .chunks(chunk_len)
+                .zip(intermediates.chunks(chunk_len))
+                .map(|(s, i)| {
+                    scope.spawn(move || {
+                        let mut equations = NormalEquations::new(duration);
+                        for (x, values) in s.iter().zip(i.iter()) {
+                            equations.update(x, values);
+                        }
+                        equations
+                    })
+                })
+                .collect();
+            handles.into_iter().map(|h| h.join().unwrap()).collect()
+        });
+
+        for p in partials.iter() {
+            self.equations.merge(p);
+        }
+    }
+
+    // Coefficient of determination (R²) of each guess, at each sample
+    pub fn get_result(&self) -> Vec<Vec<f64>> {
+        let eq = &self.equations;
+        let n = eq.n as f64;
+
+        (0..N_GUESSES)
+            .map(|guess| {
+                // Small ridge term, some bits may not have been observed yet
+                let gram: Vec<Vec<f64>> = (0..N_COEFFICIENTS)
+                    .map(|i| {
+                        (0..N_COEFFICIENTS)
+                            .map(|j| eq.gram[guess][i][j] + if i == j { 1e-9 } else { 0.0 })
+                            .collect()
+                    })
+                    .collect();
+                let l = match cholesky(&gram) {
+                    Ok(l) => l,
+                    Err(_) => return vec![0.0; eq.duration],
+                };
+
+                let moments: Vec<Vec<f64>> = eq.moments[guess]
+                    .chunks(eq.duration)
+                    .map(|m| m.to_vec())
+                    .collect();
+
+                // b^T G^-1 b = |L^-1 b|², for each sample
+                let explained: Vec<f64> = transpose(&moments)
+                    .iter()
+                    .map(|b| {
+                        forward_substitution(&l, b)
+                            .iter()
+                            .map(|z| z * z)
+                            .sum()
+                    })
+                    .collect();
+
+                (0..eq.duration)
+                    .map(|t| {
+                        let sum = moments[0][t];
+                        let sst = eq.sum_squares[t] - sum * sum / n;
+                        let ssr = eq.sum_squares[t] - explained[t];
+                        if sst > 0.0 {
+                            1.0 - ssr / sst
+                        } else {
+                            0.0
+                        }
+                    })
+                    .collect()
+            })
+            .collect()
+    }
+}
@@ -0,0 +1,215 @@
+use std::error::Error;
+
+// Compression of the 12-bit ADC samples, see esp_cpa_board.sample_codec.
+//
+// Samples are predicted from the previous one, and the residuals are taken
+// modulo 2^12, so that they fit in 12 bits whatever their sign. Residuals are
+// zigzag encoded, then bitpacked by blocks, each block with the smallest
+// width holding all its residuals. Neighbouring samples being correlated, the
+// residuals are small and most blocks need far less than 12 bits per sample.
+//
+// Layout:
+//   version (u8), mode (u8), number of samples (u64, little endian)
+//   mode MODE_RAW:    the samples, as i16 little endian
+//   mode MODE_PACKED: for each block, its width (u8) and its packed residuals,
+//                     LSB first, padded to a whole byte
+
+const VERSION: u8 = 1;
+const MODE_RAW: u8 = 0;
+const MODE_PACKED: u8 = 1;
+const HEADER_SIZE: usize = 10;
+
+const BLOCK_SIZE: usize = 128;
+const SAMPLE_BITS: u32 = 12;
+const SAMPLE_MASK: u16 = (1 << SAMPLE_BITS) - 1;
+
+// Sign extension of a 12-bit value
+fn sign_extend(value: u16) -> i16 {
+    ((value << 4) as i16) >> 4
+}
+
+fn zigzag(residual: i16) -> u16 {
+    ((residual << 1) ^ (residual >> 15)) as u16
+}
+
+fn unzigzag(value: u16) -> i16 {
+    ((value >> 1) as i16) ^ -((value & 1) as i16)
+}
+
+fn residuals(samples: &[i16]) -> Vec<u16> {
+    let mut previous = 0i16;
+    samples
+        .iter()
+        .map(|&sample| {
+            let residual = (sample.wrapping_sub(previous) as u16) & SAMPLE_MASK;
+            previous = sample;
+            zigzag(sign_extend(residual))
+        })
+        .collect()
+}
+
+pub fn encode(samples: &[i16]) -> Vec<u8> {
+    let mut encoded = Vec::with_capacity(HEADER_SIZE + samples.len() * 2);
+    encoded.push(VERSION);
+
+    // Anything else than 12-bit values is stored as is
+    if samples.iter().any(|&s| !(-2048..=2047).contains(&s)) {
+        encoded.push(MODE_RAW);
+        encoded.extend_from_slice(&(samples.len() as u64).to_le_bytes());
+        for sample in samples {
+            encoded.extend_from_slice(&sample.to_le_bytes());
+        }
+        return encoded;
+    }
+
+    encoded.push(MODE_PACKED);
+    encoded.extend_from_slice(&(samples.len() as u64).to_le_bytes());
+
+    for block in residuals(samples).chunks(BLOCK_SIZE) {
+        let width = 16 - block.iter().fold(0, |acc, &r| acc | r).leading_zeros();
+        encoded.push(width as u8);
+
+        let mut buffer = 0u64;
+        let mut n_bits = 0;
+        for &residual in block {
+            buffer |= (residual as u64) << n_bits;
+            n_bits += width;
+            while n_bits >= 8 {
+                encoded.push(buffer as u8);
+                buffer >>= 8;
+                n_bits -= 8;
+            }
+        }
+        if n_bits > 0 {
+            encoded.push(buffer as u8);
+        }
+    }
+
+    encoded
+}
+
+pub fn decode(encoded: &[u8]) -> Result<Vec<i16>, Box<dyn Error + Send + Sync>> {
+    if encoded.len() < HEADER_SIZE {
+        return Err("Truncated header".into());
+    }
+    if encoded[0] != VERSION {
+        return Err(format!("Unsupported version {}", encoded[0]).into());
+    }
+    let n_samples = u64::from_le_bytes(encoded[2..HEADER_SIZE].try_into().unwrap()) as usize;
+    let data = &encoded[HEADER_SIZE..];
+
+    match encoded[1] {
+        MODE_RAW => {
+            if n_samples.checked_mul(2) != Some(data.len()) {
+                return Err("Invalid raw data size".into());
+            }
+            Ok(data
+                .chunks_exact(2)
+                .map(|b| i16::from_le_bytes([b[0], b[1]]))
+                .collect())
+        }
+        MODE_PACKED => decode_packed(data, n_samples),
+        mode => Err(format!("Unknown mode {}", mode).into()),
+    }
+}
+
+fn decode_packed(data: &[u8], n_samples: usize) -> Result<Vec<i16>, Box<dyn Error + Send + Sync>> {
+    // Each block takes at least its width byte, a corrupt header must not
+    // cause a huge allocation
+    if n_samples.div_ceil(BLOCK_SIZE) > data.len() {
+        return Err("Invalid number of samples".into());
+    }
+    let mut samples = vec![0i16; n_samples];
+    let mut previous = 0u16;
+    let mut position = 0;
+
+    for block in samples.chunks_mut(BLOCK_SIZE) {
+        let Some(&width) = data.get(position) else {
+            return Err("Truncated data".into());
+        };
+        let width = width as u32;
+        if width > SAMPLE_BITS {
+            return Err(format!("Invalid block width {}", width).into());
+        }
+        let size = (block.len() * width as usize + 7) / 8;
+        let Some(packed) = data.get(position + 1..position + 1 + size) else {
+            return Err("Truncated data".into());
+        };
+        position += 1 + size;
+
+        let mask = (1u64 << width) - 1;
+        let mut bytes = packed.iter();
+        let mut buffer = 0u64;
+        let mut n_bits = 0;
+        for sample in block.iter_mut() {
+            while n_bits < width {
+                buffer |= (*bytes.next().unwrap() as u64) << n_bits;
+                n_bits += 8;
+            }
+            let residual = unzigzag((buffer & mask) as u16);
+            buffer >>= width;
+            n_bits -= width;
+
+            previous = previous.wrapping_add(residual as u16) & SAMPLE_MASK;
+            *sample = sign_extend(previous);
+        }
+    }
+
+    if position != data.len() {
+        return Err("Trailing data".into());
+    }
+    Ok(samples)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn round_trip(samples: &[i16]) -> Vec<u8> {
+        let encoded = encode(samples);
+        assert_eq!(decode(&encoded).unwrap(), samples);
+        encoded
+    }
+
+    #[test]
+    fn packed_round_trip() {
+        // A 12-bit wide block (-2048 after the implicit 0), a 0-bit wide one,
+        // then a partial block of extreme values
+        let mut samples = vec![-2048i16; 2 * BLOCK_SIZE];
+        samples.extend([2047, -2048, 2047, 0, -1, 1, -2048, -2048, 2047]);
+
+        let encoded = round_trip(&samples);
+        assert_eq!(encoded[1], MODE_PACKED);
+        assert_eq!(encoded[HEADER_SIZE], 12);
+        let second_block = HEADER_SIZE + 1 + BLOCK_SIZE * 12 / 8;
+        assert_eq!(encoded[second_block], 0);
+        assert_eq!(encoded[second_block + 1], 12);
+    }
+
+    #[test]
+    fn raw_round_trip() {
+        for samples in [
+            vec![2048i16, 0],
+            vec![-2049i16],
+            vec![i16::MIN, i16::MAX, 5],
+        ] {
+            let encoded = round_trip(&samples);
+            assert_eq!(encoded[1], MODE_RAW);
+        }
+    }
+
+    #[test]
+    fn empty_round_trip() {
+        round_trip(&[]);
+    }
+
+    #[test]
+    fn corrupt_sample_count() {
+        for mode in [MODE_RAW, MODE_PACKED] {
+            let mut encoded = vec![VERSION, mode];
+            encoded.extend_from_slice(&u64::MAX.to_le_bytes());
+            encoded.extend_from_slice(&[0; 4]);
+            assert!(decode(&encoded).is_err());
+        }
+    }
+}
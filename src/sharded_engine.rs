@@ -0,0 +1,220 @@
+use std::collections::HashMap;
+use std::error::Error;
+use std::ops::Range;
+use std::sync::{Mutex, OnceLock};
+use std::thread;
+use std::time::Instant;
+
+use super::correlation_engine::{EngineStats, OpenclCorrelationEngine};
+use super::opencl_context::DeviceSelection;
+
+// Size of the calibration workload
+const CALIBRATION_DURATION: usize = 16;
+const CALIBRATION_GUESSES: usize = 256;
+const CALIBRATION_SAMPLES: usize = 4096;
+const CALIBRATION_ROUNDS: usize = 3;
+
+// Correlation engine spreading the guesses over several OpenCL devices.
+// Each device gets all the samples and a contiguous range of guesses, sized
+// after its measured throughput. The rows of the result are gathered back in
+// guess order, so this is a drop-in replacement of OpenclCorrelationEngine.
+pub struct ShardedCorrelationEngine {
+    shards: Vec<(Range<usize>, OpenclCorrelationEngine)>,
+    n_guesses: usize,
+    n_groups: usize,
+}
+
+// Measured throughputs, in (sample, guess, trace) per second, per device
+fn throughputs() -> &'static Mutex<HashMap<DeviceSelection, f64>> {
+    static THROUGHPUTS: OnceLock<Mutex<HashMap<DeviceSelection, f64>>> = OnceLock::new();
+    THROUGHPUTS.get_or_init(|| Mutex::new(HashMap::new()))
+}
+
+// Time a fixed workload on the device, once per process
+fn device_throughput(selection: &DeviceSelection) -> Result<f64, Box<dyn Error>> {
+    if let Some(throughput) = throughputs().lock().unwrap().get(selection) {
+        return Ok(*throughput);
+    }
+
+    let samples: Vec<Vec<f64>> = (0..CALIBRATION_DURATION)
+        .map(|i| {
+            (0..CALIBRATION_SAMPLES)
+                .map(|j| ((i * 31 + j * 17) % 251) as f64)
+                .collect()
+        })
+        .collect();
+    let guesses: Vec<Vec<f64>> = (0..CALIBRATION_GUESSES)
+        .map(|i| {
+            (0..CALIBRATION_SAMPLES)
+                .map(|j| ((i ^ j) % 9) as f64)
+                .collect()
+        })
+        .collect();
+
+    let mut engine = OpenclCorrelationEngine::with_options(
+        CALIBRATION_DURATION,
+        CALIBRATION_GUESSES,
+        false,
+        selection,
+    )?;
+
+    // The first run includes the lazy initializations of the driver
+    engine.update(samples.clone(), guesses.clone())?;
+    engine.get_result()?;
+
+    let start = Instant::now();
+    for _ in 0..CALIBRATION_ROUNDS {
+        engine.update(samples.clone(), guesses.clone())?;
+    }
+    // Reading the result back waits for the kernels
+    engine.get_result()?;
+    let seconds = start.elapsed().as_secs_f64().max(1e-9);
+
+    let work =
+        CALIBRATION_ROUNDS * CALIBRATION_DURATION * CALIBRATION_GUESSES * CALIBRATION_SAMPLES;
+    let throughput = work as f64 / seconds;
+    throughputs().lock().unwrap().insert(*selection, throughput);
+    Ok(throughput)
+}
+
+// Split 0..n into consecutive ranges, proportional to the weights
+fn partition(n: usize, weights: &[f64]) -> Vec<Range<usize>> {
+    let total: f64 = weights.iter().sum();
+    let mut ranges = Vec::with_capacity(weights.len());
+    let mut cumulative = 0.0;
+    let mut start = 0;
+    for (i, weight) in weights.iter().enumerate() {
+        cumulative += weight;
+        let end = if i + 1 == weights.len() {
+            n
+        } else {
+            ((n as f64 * cumulative / total).round() as usize).clamp(start, n)
+        };
+        ranges.push(start..end);
+        start = end;
+    }
+    ranges
+}
+
+impl ShardedCorrelationEngine {
+    // Devices are usually given by DeviceSelection::expand(). For groups, see
+    // OpenclCorrelationEngine::with_groups(): each device gets the same range
+    // of guesses in every group.
+    pub fn with_groups(
+        sample_duration: usize,
+        n_guesses: usize,
+        profiling: bool,
+        selections: &[DeviceSelection],
+        groups: Option<&[u32]>,
+    ) -> Result<Self, Box<dyn Error>> {
+        // No need to calibrate a single device
+        let weights = if selections.len() > 1 {
+            selections
+                .iter()
+                .map(device_throughput)
+                .collect::<Result<Vec<f64>, _>>()?
+        } else {
+            vec![1.0; selections.len()]
+        };
+
+        let mut shards = Vec::new();
+        for (range, selection) in partition(n_guesses, &weights)
+            .into_iter()
+            .zip(selections.iter())
+        {
+            // Too slow a device may get no guess at all
+            if range.is_empty() {
+                continue;
+            }
+            let engine = OpenclCorrelationEngine::with_groups(
+                sample_duration,
+                range.len(),
+                profiling,
+                selection,
+                groups,
+            )?;
+            shards.push((range, engine));
+        }
+        if shards.is_empty() {
+            return Err("No OpenCL device to run on".into());
+        }
+
+        let n_groups = groups
+            .and_then(|g| g.iter().max())
+            .map_or(1, |g| *g as usize + 1);
+
+        Ok(ShardedCorrelationEngine {
+            shards,
+            n_guesses,
+            n_groups,
+        })
+    }
+
+    pub fn update(
+        &mut self,
+        samples: Vec<Vec<f64>>,
+        guesses: Vec<Vec<f64>>,
+    ) -> Result<(), Box<dyn Error>> {
+        if self.shards.len() == 1 {
+            return self.shards[0].1.update(samples, guesses);
+        }
+
+        // Guesses come group after group, each shard takes its range in each
+        let (n_groups, n_guesses) = (self.n_groups, self.n_guesses);
+        let mut guesses: Vec<Option<Vec<f64>>> = guesses.into_iter().map(Some).collect();
+        let inputs: Vec<(Vec<Vec<f64>>, Vec<Vec<f64>>)> = self
+            .shards
+            .iter()
+            .map(|(range, _)| {
+                let rows = (0..n_groups)
+                    .flat_map(|g| range.clone().map(move |i| g * n_guesses + i))
+                    .map(|row| guesses[row].take().unwrap())
+                    .collect();
+                (samples.clone(), rows)
+            })
+            .collect();
+
+        // Host side preparation and transfers run concurrently, one thread per
+        // device. Kernels are enqueued without waiting for their completion.
+        let results: Vec<Result<(), String>> = thread::scope(|scope| {
+            let handles: Vec<_> = self
+                .shards
+                .iter_mut()
+                .zip(inputs)
+                .map(|((_, engine), (samples, guesses))| {
+                    scope.spawn(move || engine.update(samples, guesses).map_err(|e| e.to_string()))
+                })
+                .collect();
+            handles.into_iter().map(|h| h.join().unwrap()).collect()
+        });
+
+        for result in results {
+            result?;
+        }
+        Ok(())
+    }
+
+    pub fn get_result(&self) -> Result<Vec<Vec<f64>>, Box<dyn Error>> {
+        let mut result = Vec::new();
+        for (_, engine) in self.shards.iter() {
+            result.extend(engine.get_result()?);
+        }
+        Ok(result)
+    }
+
+    // Timings are summed over the devices, and may exceed the wall-clock time
+    pub fn stats(&self) -> EngineStats {
+        let mut stats = EngineStats::default();
+        for (_, engine) in self.shards.iter() {
+            let shard = engine.stats();
+            stats.n_updates = shard.n_updates;
+            stats.n_traces = shard.n_traces;
+            stats.flatten_ns += shard.flatten_ns;
+            stats.buffer_creation_ns += shard.buffer_creation_ns;
+            stats.host_to_device_ns += shard.host_to_device_ns;
+            stats.kernel_ns += shard.kernel_ns;
+            stats.readback_ns += shard.readback_ns;
+        }
+        stats
+    }
+}
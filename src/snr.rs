@@ -0,0 +1,111 @@
+use std::thread;
+
+const N_CLASSES: usize = 256;
+
+// Per plaintext byte value moments, for one byte position. Means and sums of
+// squared deviations are updated with Welford's method, which stays accurate
+// over millions of traces.
+struct ClassMoments {
+    duration: usize,
+    counts: Vec<u64>,
+    means: Vec<f64>, // N_CLASSES x duration
+    m2: Vec<f64>,    // N_CLASSES x duration
+}
+
+impl ClassMoments {
+    fn new(duration: usize) -> Self {
+        ClassMoments {
+            duration,
+            counts: vec![0; N_CLASSES],
+            means: vec![0.0; N_CLASSES * duration],
+            m2: vec![0.0; N_CLASSES * duration],
+        }
+    }
+
+    fn update(&mut self, payloads: &[[u8; 16]], samples: &[Vec<f64>], index: usize) {
+        for (p, x) in payloads.iter().zip(samples.iter()) {
+            let c = p[index] as usize;
+            self.counts[c] += 1;
+            let count = self.counts[c] as f64;
+
+            let range = c * self.duration..(c + 1) * self.duration;
+            for ((m, m2), v) in self.means[range.clone()]
+                .iter_mut()
+                .zip(self.m2[range].iter_mut())
+                .zip(x.iter())
+            {
+                let delta = v - *m;
+                *m += delta / count;
+                *m2 += delta * (v - *m);
+            }
+        }
+    }
+
+    // Signal-to-noise ratio and normalized inter-class variance of each sample
+    fn get_result(&self) -> (Vec<f64>, Vec<f64>) {
+        let n: f64 = self.counts.iter().sum::<u64>() as f64;
+
+        let mut snr = vec![0.0f64; self.duration];
+        let mut nicv = vec![0.0f64; self.duration];
+        if n == 0.0 {
+            return (snr, nicv);
+        }
+
+        for t in 0..self.duration {
+            let mean: f64 = self
+                .counts
+                .iter()
+                .enumerate()
+                .map(|(c, count)| *count as f64 * self.means[c * self.duration + t])
+                .sum::<f64>()
+                / n;
+
+            // The total variance splits into the inter and intra-class ones
+            let mut between = 0.0f64;
+            let mut within = 0.0f64;
+            for (c, count) in self.counts.iter().enumerate() {
+                if *count == 0 {
+                    continue;
+                }
+                let class_mean = self.means[c * self.duration + t];
+                between += *count as f64 * (class_mean - mean) * (class_mean - mean) / n;
+                within += self.m2[c * self.duration + t] / n;
+            }
+            let total_variance = between + within;
+
+            if within > 0.0 {
+                snr[t] = between / within;
+            }
+            if total_variance > 0.0 {
+                nicv[t] = between / total_variance;
+            }
+        }
+
+        (snr, nicv)
+    }
+}
+
+pub struct SnrEngine {
+    moments: Vec<ClassMoments>, // One per byte position
+}
+
+impl SnrEngine {
+    pub fn new(duration: usize) -> Self {
+        SnrEngine {
+            moments: (0..16).map(|_| ClassMoments::new(duration)).collect(),
+        }
+    }
+
+    pub fn update(&mut self, payloads: &[[u8; 16]], samples: &[Vec<f64>]) {
+        // One thread per byte position
+        thread::scope(|scope| {
+            for (index, moments) in self.moments.iter_mut().enumerate() {
+                scope.spawn(move || moments.update(payloads, samples, index));
+            }
+        });
+    }
+
+    pub fn get_result(&self) -> (Vec<Vec<f64>>, Vec<Vec<f64>>) {
+        self.moments.iter().map(|m| m.get_result()).unzip()
+    }
+}
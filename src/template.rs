@@ -0,0 +1,316 @@
+use std::error::Error;
+use std::thread;
+
+use super::linalg::{
+    cholesky, forward_substitution, identity, lower_triangular_inverse, mul, symmetric_eigen,
+    transpose, Matrix,
+};
+
+const N_CLASSES: usize = 256;
+
+// Per-class means and pooled scatter matrix, updated in a streaming fashion
+#[derive(Clone)]
+pub struct ClassStatistics {
+    dim: usize,
+    counts: Vec<u64>,
+    means: Vec<Vec<f64>>,
+    scatter: Matrix,
+}
+
+impl ClassStatistics {
+    pub fn new(dim: usize) -> Self {
+        ClassStatistics {
+            dim,
+            counts: vec![0; N_CLASSES],
+            means: vec![vec![0.0; dim]; N_CLASSES],
+            scatter: vec![vec![0.0; dim]; dim],
+        }
+    }
+
+    pub fn update(&mut self, x: &[f64], class: u8) {
+        let c = class as usize;
+        self.counts[c] += 1;
+        let n = self.counts[c] as f64;
+
+        let delta: Vec<f64> = x.iter().zip(self.means[c].iter()).map(|(x, m)| x - m).collect();
+        for (m, d) in self.means[c].iter_mut().zip(delta.iter()) {
+            *m += d / n;
+        }
+        let delta2: Vec<f64> = x.iter().zip(self.means[c].iter()).map(|(x, m)| x - m).collect();
+
+        for i in 0..self.dim {
+            for j in 0..self.dim {
+                self.scatter[i][j] += delta[i] * delta2[j];
+            }
+        }
+    }
+
+    pub fn merge(&mut self, other: &ClassStatistics) {
+        for c in 0..N_CLASSES {
+            let n_b = other.counts[c] as f64;
+            if n_b == 0.0 {
+                continue;
+            }
+            let n_a = self.counts[c] as f64;
+            let n = n_a + n_b;
+
+            let delta: Vec<f64> = other.means[c]
+                .iter()
+                .zip(self.means[c].iter())
+                .map(|(b, a)| b - a)
+                .collect();
+
+            for i in 0..self.dim {
+                for j in 0..self.dim {
+                    self.scatter[i][j] += delta[i] * delta[j] * n_a * n_b / n;
+                }
+            }
+            for (m, d) in self.means[c].iter_mut().zip(delta.iter()) {
+                *m += d * n_b / n;
+            }
+            self.counts[c] += other.counts[c];
+        }
+
+        for i in 0..self.dim {
+            for j in 0..self.dim {
+                self.scatter[i][j] += other.scatter[i][j];
+            }
+        }
+    }
+
+    fn n_observed_classes(&self) -> usize {
+        self.counts.iter().filter(|&&n| n > 0).count()
+    }
+
+    fn total_count(&self) -> u64 {
+        self.counts.iter().sum()
+    }
+
+    fn pooled_covariance(&self) -> Matrix {
+        let dof = (self.total_count() as f64 - self.n_observed_classes() as f64).max(1.0);
+        self.scatter
+            .iter()
+            .map(|row| row.iter().map(|v| v / dof).collect())
+            .collect()
+    }
+
+    // Scatter of the class means around their (count weighted) global mean
+    fn between_class_scatter(&self) -> Matrix {
+        let total = self.total_count() as f64;
+        let mut global_mean = vec![0.0f64; self.dim];
+        for (n, m) in self.counts.iter().zip(self.means.iter()) {
+            for (g, v) in global_mean.iter_mut().zip(m.iter()) {
+                *g += v * *n as f64 / total;
+            }
+        }
+
+        let mut scatter = vec![vec![0.0f64; self.dim]; self.dim];
+        for (n, m) in self.counts.iter().zip(self.means.iter()) {
+            if *n == 0 {
+                continue;
+            }
+            let d: Vec<f64> = m.iter().zip(global_mean.iter()).map(|(m, g)| m - g).collect();
+            for i in 0..self.dim {
+                for j in 0..self.dim {
+                    scatter[i][j] += *n as f64 * d[i] * d[j];
+                }
+            }
+        }
+        scatter
+    }
+}
+
+pub enum Projection {
+    None,
+    Pca,
+    Lda,
+}
+
+pub struct Templates {
+    pub projection: Matrix, // dim x n_components
+    pub means: Matrix,      // N_CLASSES x n_components
+    pub covariance: Matrix, // n_components x n_components
+}
+
+fn n_threads() -> usize {
+    thread::available_parallelism()
+        .map(|n| n.get())
+        .unwrap_or(1)
+}
+
+pub struct TemplateProfilingEngine {
+    statistics: ClassStatistics,
+}
+
+impl TemplateProfilingEngine {
+    pub fn new(dim: usize) -> Self {
+        TemplateProfilingEngine {
+            statistics: ClassStatistics::new(dim),
+        }
+    }
+
+    pub fn update(&mut self, samples: &[Vec<f64>], classes: &[u8]) {
+        let dim = self.statistics.dim;
+        let chunk_len = (samples.len() + n_threads() - 1) / n_threads();
+        if chunk_len == 0 {
+            return;
+        }
+
+        // Accumulate each share of the traces independently, then merge
+        let partials: Vec<ClassStatistics> = thread::scope(|scope| {
+            let handles: Vec<_> = samples
+                .chunks(chunk_len)
+                .zip(classes.chunks(chunk_len))
+                .map(|(s, c)| {
+                    scope.spawn(move || {
+                        let mut statistics = ClassStatistics::new(dim);
+                        for (x, class) in s.iter().zip(c.iter()) {
+                            statistics.update(x, *class);
+                        }
+                        statistics
+                    })
+                })
+                .collect();
+            handles.into_iter().map(|h| h.join().unwrap()).collect()
+        });
+
+        for p in partials.iter() {
+            self.statistics.merge(p);
+        }
+    }
+
+    pub fn get_templates(
+        &self,
+        projection: Projection,
+        n_components: usize,
+    ) -> Result<Templates, Box<dyn Error>> {
+        let dim = self.statistics.dim;
+        let covariance = self.statistics.pooled_covariance();
+
+        let w: Matrix = match projection {
+            Projection::None => identity(dim),
+            Projection::Pca => {
+                // Principal components of the class means
+                let (_, vectors) = symmetric_eigen(&self.statistics.between_class_scatter());
+                vectors
+                    .iter()
+                    .map(|row| row[..n_components.min(dim)].to_vec())
+                    .collect()
+            }
+            Projection::Lda => {
+                // Generalized eigenvectors of (Sb, Sw), computed by whitening Sw
+                let l = cholesky(&covariance)?;
+                let l_inv = lower_triangular_inverse(&l);
+                let sb = self.statistics.between_class_scatter();
+                let m = mul(&mul(&l_inv, &sb), &transpose(&l_inv));
+                let (_, vectors) = symmetric_eigen(&m);
+                let vectors: Matrix = vectors
+                    .iter()
+                    .map(|row| row[..n_components.min(dim)].to_vec())
+                    .collect();
+                mul(&transpose(&l_inv), &vectors)
+            }
+        };
+
+        let wt = transpose(&w);
+        let means = mul(&self.statistics.means, &w);
+        let covariance = mul(&mul(&wt, &covariance), &w);
+
+        Ok(Templates {
+            projection: w,
+            means,
+            covariance,
+        })
+    }
+}
+
+pub struct TemplateAttackEngine {
+    projection: Matrix,
+    // Class means and traces are whitened, so that distances are euclidean
+    whitening: Matrix,
+    whitened_means: Matrix,
+    log_likelihoods: Vec<f64>,
+}
+
+impl TemplateAttackEngine {
+    pub fn new(templates: Templates) -> Result<Self, Box<dyn Error>> {
+        let l = cholesky(&templates.covariance)?;
+
+        let whitened_means = templates
+            .means
+            .iter()
+            .map(|m| forward_substitution(&l, m))
+            .collect();
+
+        Ok(TemplateAttackEngine {
+            projection: templates.projection,
+            whitening: lower_triangular_inverse(&l),
+            whitened_means,
+            log_likelihoods: vec![0.0; N_CLASSES],
+        })
+    }
+
+    fn class_log_likelihoods(&self, x: &[f64]) -> Vec<f64> {
+        let n_components = self.whitening.len();
+
+        let mut y = vec![0.0f64; n_components];
+        for (i, v) in x.iter().enumerate() {
+            for (j, y) in y.iter_mut().enumerate() {
+                *y += v * self.projection[i][j];
+            }
+        }
+        let z: Vec<f64> = self
+            .whitening
+            .iter()
+            .map(|row| row.iter().zip(y.iter()).map(|(a, b)| a * b).sum())
+            .collect();
+
+        self.whitened_means
+            .iter()
+            .map(|m| {
+                let d: f64 = m.iter().zip(z.iter()).map(|(m, z)| (z - m) * (z - m)).sum();
+                -0.5 * d
+            })
+            .collect()
+    }
+
+    // classes[n][g] is the class of trace n under the guess g
+    pub fn update(&mut self, samples: &[Vec<f64>], classes: &[Vec<u8>]) {
+        let chunk_len = (samples.len() + n_threads() - 1) / n_threads();
+        if chunk_len == 0 {
+            return;
+        }
+
+        let this = &*self;
+        let partials: Vec<Vec<f64>> = thread::scope(|scope| {
+            let handles: Vec<_> = samples
+                .chunks(chunk_len)
+                .zip(classes.chunks(chunk_len))
+                .map(|(s, c)| {
+                    scope.spawn(move || {
+                        let mut log_likelihoods = vec![0.0f64; N_CLASSES];
+                        for (x, guess_classes) in s.iter().zip(c.iter()) {
+                            let ll = this.class_log_likelihoods(x);
+                            for (r, class) in log_likelihoods.iter_mut().zip(guess_classes.iter())
+                            {
+                                *r += ll[*class as usize];
+                            }
+                        }
+                        log_likelihoods
+                    })
+                })
+                .collect();
+            handles.into_iter().map(|h| h.join().unwrap()).collect()
+        });
+
+        for p in partials.iter() {
+            for (r, v) in self.log_likelihoods.iter_mut().zip(p.iter()) {
+                *r += v;
+            }
+        }
+    }
+
+    pub fn get_result(&self) -> Vec<f64> {
+        self.log_likelihoods.clone()
+    }
+}
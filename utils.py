@@ -1,11 +1,22 @@
 #!/usr/bin/env python3
 """Misc utils."""
 
+import os
+import tempfile
+import time
 from pathlib import Path
-from typing import List
+from typing import Annotated, Callable, Dict, List
 
+import numpy as np
 import typer
 import zarr
+from rich import print
+from rich.progress import track
+from rich.table import Table
+
+from esp_cpa_board import SampleCodec
+from esp_cpa_board.aes_utils import derivate_round_keys
+from esp_cpa_board.simulated_board import leakage_signal, leakage_table
 
 app = typer.Typer()
 
@@ -31,6 +42,7 @@ def fuse(
                 n_samples,
             ),
             dtype="i2",
+            compressor=SampleCodec(),
             chunks=(
                 sync_step,
                 averaging,
@@ -51,17 +63,230 @@ def fuse(
             dtype="f",
         )
 
-        for source in zarr_files:
+        boards_array = output_f.create_dataset(
+            "boards",
+            shape=(0,),
+            chunks=(sync_step,),
+            dtype="u1",
+        )
+        board_names: List[str] = []
+
+        for filename, source in zip(input_filenames, zarr_files):
+            # Captures without board-id column come from a single board
+            names = list(source.attrs.get("boards", [filename.stem]))
+            for name in names:
+                if name not in board_names:
+                    board_names.append(name)
+            board_ids = np.array([board_names.index(n) for n in names], dtype="u1")
+
             for i in range(0, source["samples"].shape[0], sync_step):
                 samples_array.append(source["samples"][i : i + sync_step])
                 payloads_array.append(source["payloads"][i : i + sync_step])
+                if "boards" in source:
+                    boards_array.append(board_ids[source["boards"][i : i + sync_step]])
+                else:
+                    n = source["payloads"][i : i + sync_step].shape[0]
+                    boards_array.append(np.full(n, board_ids[0], dtype="u1"))
 
             assert (
                 samples_array.shape[0] == payloads_array.shape[0]
             ), "samples / payload count mismatch"
 
-            for i in range(0, source["temperatures"].shape[0], sync_step // temp_rate):
-                temperatures_array.append(source["temperatures"][i : i + sync_step])
+            # Temperature k belongs to the traces k * temp_rate to (k + 1) * temp_rate - 1
+            n_temperatures = min(
+                source["temperatures"].shape[0],
+                -(-source["samples"].shape[0] // temp_rate),
+            )
+            for i in range(0, n_temperatures, sync_step // temp_rate):
+                temperatures_array.append(
+                    source["temperatures"][
+                        i : min(i + sync_step // temp_rate, n_temperatures)
+                    ]
+                )
+
+        output_f.attrs["boards"] = board_names
+
+
+@app.command()
+def generate_capture(
+    output_filename: Path,
+    key_file: Annotated[
+        Path,
+        typer.Argument(help="XTS key file, generated if it doesn't exist"),
+    ],
+    n_measurements: int = 50_000,
+    averaging: int = 16,
+    n_samples: int = 1024,
+    model: str = "round0dectable",
+    leakage_offset: int = 300,
+    leakage_spacing: int = 24,
+    leakage_amplitude: float = 8.0,
+    noise: float = 20.0,
+    seed: int = 0,
+) -> None:
+    """Generate a synthetic capture, with the same layout as measure.py captures.
+
+    The round 0 key byte j leaks at sample leakage_offset + j * leakage_spacing,
+    as a short burst modulated by the Hamming weight of the targeted intermediate
+    value. Gaussian noise is added to each repetition.
+    """
+    rng = np.random.default_rng(seed)
+
+    if not key_file.exists():
+        key_file.write_bytes(rng.bytes(32))
+    round_key = derivate_round_keys(key_file)[0]
+
+    if leakage_offset + 16 * leakage_spacing + 20 > n_samples:
+        raise typer.BadParameter("Leakage doesn't fit in the traces")
+
+    try:
+        leakage = leakage_table(model)
+    except ValueError as e:
+        raise typer.BadParameter(str(e))
+
+    sync_step = 5000  # Same chunking as measure.py
+    temp_rate = 100  # Record a temperature data point each temp_rate sample
+    with zarr.open(output_filename, "w-") as output_f:
+        samples_array = output_f.create_dataset(
+            "samples",
+            shape=(0, averaging, n_samples),
+            dtype="i2",
+            compressor=SampleCodec(),
+            chunks=(sync_step, averaging, n_samples),
+        )
+        payloads_array = output_f.create_dataset(
+            "payloads",
+            shape=(0, 16),
+            chunks=(sync_step, 16),
+            dtype="u1",
+            compressor=None,  # Compressing random data is wasteful
+        )
+        temperatures_array = output_f.create_dataset(
+            "temperatures",
+            shape=(0,),
+            chunks=(sync_step // temp_rate,),
+            dtype="f",
+        )
+
+        for i in track(range(0, n_measurements, sync_step)):
+            n = min(sync_step, n_measurements - i)
+
+            payloads = rng.integers(0, 256, size=(n, 16), dtype=np.uint8)
+            # Payloads are stored in reverse order (ESP32 implementation detail)
+            plaintext = np.flip(payloads, axis=1)
+
+            signal = leakage_signal(
+                plaintext,
+                round_key,
+                n_samples,
+                leakage,
+                leakage_offset,
+                leakage_spacing,
+                leakage_amplitude,
+            )
+
+            samples = rng.standard_normal(
+                size=(n, averaging, n_samples), dtype=np.float32
+            )
+            samples = samples * noise + signal[:, None, :]
+
+            samples_array.append(np.clip(np.round(samples), -32768, 32767))
+            payloads_array.append(payloads)
+            temperatures_array.append(
+                (35.0 + rng.normal(0.0, 0.05, size=n // temp_rate)).astype("f")
+            )
+
+    print(f"Round key = {round_key.hex()}")
+
+
+def _time_stage(stage: Callable[[], None]) -> float:
+    """Run a pipeline stage.
+
+    Args:
+        stage (Callable[[], None]): The stage
+
+    Returns:
+        float: The elapsed time, in seconds
+    """
+    start = time.perf_counter()
+    stage()
+    return time.perf_counter() - start
+
+
+@app.command()
+def benchmark_pipeline(
+    data_filename: Path,
+    key_file: Path,
+    analysis_config_filename: Path,
+    group_config_filename: Path,
+    leakage_config_filename: Path = Path("config/analysis/leakage_assessment.py"),
+    stage: Annotated[
+        List[str],
+        typer.Option(help="Stages to run, all of them by default"),
+    ] = [
+        "compute_correlations",
+        "leakage_assessment",
+        "group_measurements",
+        "compute_ranks",
+    ],
+) -> None:
+    """Time the analysis pipeline on a capture, and report throughputs.
+
+    Outputs are written to a temporary directory. compute_ranks depends on the
+    output of compute_correlations.
+    """
+    # Imported here, so that the other tools don't depend on the Rust library
+    import analyze
+
+    data_filename = data_filename.absolute()
+    key_file = key_file.absolute()
+    analysis_config_filename = analysis_config_filename.absolute()
+    group_config_filename = group_config_filename.absolute()
+    leakage_config_filename = leakage_config_filename.absolute()
+
+    data_f = zarr.open(data_filename, "r")
+    chunk_size = data_f["samples"].chunks[0]
+    n_traces = (data_f["payloads"].shape[0] // chunk_size) * chunk_size
+
+    round_key = derivate_round_keys(key_file)[0].hex()
+
+    cwd = os.getcwd()
+    timings: Dict[str, float] = {}
+    with tempfile.TemporaryDirectory() as output_directory:
+        # group_measurements writes to the current directory
+        os.chdir(output_directory)
+        try:
+            stages: Dict[str, Callable[[], None]] = {
+                "compute_correlations": lambda: analyze.compute_correlations(
+                    data_filename, analysis_config_filename, Path("corr.zarr")
+                ),
+                "leakage_assessment": lambda: analyze.leakage_assessment(
+                    data_filename,
+                    leakage_config_filename,
+                    key_file,
+                    Path("assessment.csv"),
+                ),
+                "group_measurements": lambda: analyze.group_measurements(
+                    data_filename, group_config_filename
+                ),
+                "compute_ranks": lambda: analyze.compute_ranks(
+                    Path("corr.zarr"), round_key, Path("ranks.csv")
+                ),
+            }
+            for name in stage:
+                if name not in stages:
+                    raise typer.BadParameter(f"Unknown stage {name}")
+                timings[name] = _time_stage(stages[name])
+        finally:
+            os.chdir(cwd)
+
+    table = Table(title=f"{n_traces} traces")
+    table.add_column("Stage")
+    table.add_column("Time (s)", justify="right")
+    table.add_column("Traces/s", justify="right")
+    for name, elapsed in timings.items():
+        table.add_row(name, f"{elapsed:0.2f}", f"{n_traces / elapsed:0.0f}")
+    print(table)
 
 
 @app.command()